@@ -0,0 +1,88 @@
+#include "SimHal.h"
+#include <Arduino.h>
+
+static const uint8_t RELAY_PINS[] = {
+    RELAY_TANK1_SUGAR,     RELAY_TANK2_COFFEE, RELAY_TANK3_NESCAFE,
+    RELAY_PUMP_WATER,      RELAY_PUMP_MILK,    RELAY_HEATER_INTERNAL,
+    RELAY_HEATER_EXTERNAL, RELAY_MIXER_ROTATE, RELAY_MIXER_UP,
+    RELAY_MIXER_DOWN};
+
+SimHal::SimHal()
+    : ready(false), switches(0), blockC(SIM_AMBIENT_C), tcC(SIM_AMBIENT_C),
+      extC(SIM_AMBIENT_C), mixerPos(0), cup(false), splashed(false), tcFailed(false), water(0),
+      milk(0), intSample(NAN), extSample(NAN), sampleMs(0),
+      tempEveryMs(TEMP_SAMPLE_MS), cupCm(NAN), cupAt(0),
+      idleRates(false), cupFast(false) {
+  memset(relays, 0, sizeof(relays));
+}
+
+void SimHal::relayOn(uint8_t relay) {
+  if (!ready || relay >= 40 || relays[relay])
+    return;
+  relays[relay] = true;
+  switches++;
+}
+
+void SimHal::relayOff(uint8_t relay) {
+  if (relay >= 40 || !relays[relay])
+    return;
+  relays[relay] = false;
+  switches++;
+}
+
+void SimHal::allRelaysOff() {
+  for (uint8_t pin : RELAY_PINS)
+    relayOff(pin);
+}
+
+bool SimHal::cupPresent() {
+  unsigned long now = millis();
+  if (isnan(cupCm) || now - cupAt >= cupFilter.sampleMs(cupFast, idleRates)) {
+    cupCm = cup && !splashed ? SIM_CUP_CM : SIM_NO_CUP_CM;
+    splashed = false;
+    cupAt = now;
+    cupFilter.push(cupCm);
+  }
+  return cupFilter.present();
+}
+
+void SimHal::pollThermocouples() {
+  unsigned long now = millis();
+  if (sampleMs != 0 && now - sampleMs < tempEveryMs)
+    return;
+  intSample = roundf(tcC / SIM_TC_STEP_C) * SIM_TC_STEP_C;
+  extSample = roundf(extC / SIM_TC_STEP_C) * SIM_TC_STEP_C;
+  sampleMs = now ? now : 1;
+}
+
+void SimHal::setIdleRates(bool idle) {
+  tempEveryMs = idle ? TEMP_SAMPLE_IDLE_MS : TEMP_SAMPLE_MS;
+  idleRates = idle;
+}
+
+void SimHal::step(unsigned long dtMs) {
+  float dt = dtMs / 1000.0f;
+
+  float watts = -SIM_BLOCK_LOSS_W_PER_C * (blockC - SIM_AMBIENT_C);
+  if (relays[RELAY_HEATER_INTERNAL])
+    watts += POWER_W_HEATER_INTERNAL;
+  if (relays[RELAY_PUMP_WATER]) {
+    watts -= SIM_PUMP_ML_PER_S * SIM_WATER_J_PER_ML_C * (blockC - SIM_INLET_C);
+    water += SIM_PUMP_ML_PER_S * dt;
+  }
+  if (relays[RELAY_PUMP_MILK])
+    milk += SIM_PUMP_ML_PER_S * dt;
+  blockC += watts * dt / SIM_BLOCK_J_PER_C;
+  tcC += (blockC - tcC) * (float)dtMs / (SIM_TC_LAG_MS + dtMs);
+
+  if (relays[RELAY_HEATER_EXTERNAL])
+    extC += SIM_EXT_C_PER_S * dt;
+  else
+    extC += (SIM_AMBIENT_C - extC) * dt / 60.0f;
+
+  bool up = relays[RELAY_MIXER_UP], down = relays[RELAY_MIXER_DOWN];
+  if (up != down) {
+    mixerPos += (down ? 1 : -1) * (float)dtMs / SIM_MIXER_TRAVEL_MS;
+    mixerPos = mixerPos < 0 ? 0 : mixerPos > 1 ? 1 : mixerPos;
+  }
+}
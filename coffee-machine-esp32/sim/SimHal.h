@@ -0,0 +1,93 @@
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include "CupFilter.h"
+#include "HAL.h"
+#include <math.h>
+
+// Machine model for the native benchmark (env:native)
+#define SIM_AMBIENT_C 22.0
+#define SIM_INLET_C 20.0
+#define SIM_BLOCK_J_PER_C 350.0  // Thermoblock thermal mass
+#define SIM_BLOCK_LOSS_W_PER_C 1.5
+#define SIM_TC_LAG_MS 1500.0     // Thermocouple first-order lag
+#define SIM_TC_STEP_C 0.25       // MAX6675 resolution
+#define SIM_PUMP_ML_PER_S 6.0
+#define SIM_WATER_J_PER_ML_C 4.18
+#define SIM_EXT_C_PER_S 0.4      // Cup warmer rise, falls back to ambient
+#define SIM_MIXER_TRAVEL_MS 2500 // Upper to lower limit
+#define SIM_CUP_CM 6.0
+#define SIM_NO_CUP_CM 60.0
+
+// Thermoblock heated by RELAY_HEATER_INTERNAL and cooled by losses and by the
+// water pump (water flows through the block, milk does not), read through a
+// lagging, 0.25C-quantised thermocouple at the MAX6675 rate. The mixer head
+// travels between the limit switches while MIXER_UP/DOWN is on. The cup is
+// pinged at the HAL rate through the same CupFilter as Esp32Hal, so a removal
+// is seen a ping gap plus the filter's median later.
+// Nothing moves on its own: step() advances the model, the caller advances
+// the clock (simAdvanceUs()).
+class SimHal : public HAL {
+public:
+  SimHal();
+  void begin() override { ready = true; }
+
+  void relayOn(uint8_t relay) override;
+  void relayOff(uint8_t relay) override;
+  void allRelaysOff() override;
+
+  bool cupPresent() override;
+  float cupDistanceCm() const override { return cupCm; }
+  uint8_t cupConfidence() const override { return cupFilter.confidence(); }
+  void setCupFast(bool fast) override { cupFast = fast; }
+  void pollThermocouples() override;
+  float readInternalTemp() override { return tcFailed ? NAN : intSample; }
+  float readExternalTemp() override { return extSample; }
+  unsigned long tempSampleMs() const override { return sampleMs; }
+  bool readLimitUpper() override { return mixerPos <= 0; }
+  bool readLimitLower() override { return mixerPos >= 1; }
+  void setIdleRates(bool idle) override;
+
+  bool isReady() override { return ready; }
+
+  // World, driven by the benchmark
+  void step(unsigned long dtMs);
+  void placeCup() { cup = true; }
+  void removeCup() { cup = false; }
+  void splash() { splashed = true; } // Next ping misses the cup (steam, drops)
+  void failThermocouple(bool failed) { tcFailed = failed; }
+
+  bool relay(uint8_t pin) const { return pin < 40 && relays[pin]; }
+  float blockTemp() const { return blockC; }
+  float waterMl() const { return water; }
+  float milkMl() const { return milk; }
+  uint32_t relaySwitches() const { return switches; }
+
+private:
+  bool ready;
+  bool relays[40]; // By GPIO number
+  uint32_t switches;
+
+  float blockC;   // Thermoblock, true
+  float tcC;      // Thermocouple junction (lags blockC)
+  float extC;     // Cup warmer
+  float mixerPos; // 0 = upper limit, 1 = lower limit
+  bool cup;
+  bool splashed;
+  bool tcFailed;
+  float water;
+  float milk;
+
+  // Samples as the HAL would report them
+  float intSample;
+  float extSample;
+  unsigned long sampleMs;
+  unsigned long tempEveryMs;
+  float cupCm;
+  unsigned long cupAt;
+  bool idleRates;
+  bool cupFast;
+  CupFilter cupFilter;
+};
+
+#endif
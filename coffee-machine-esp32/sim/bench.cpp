@@ -0,0 +1,240 @@
+// Host benchmark for MachineController on SimHal (pio run -e native -t exec).
+// Each scenario runs on simulated time in 1 ms steps. SensorTask is polled
+// at its task period and update() runs when MachineController::wakeDue()
+// says so (nextWakeMs() or a wakeEvents() change), as the firmware's
+// fsmPass() does. Reported per scenario: simulated order time, update() count
+// and host wall time per call (log2 histogram), operator new calls while the
+// order ran, heater energy, water/milk delivered and relay switches. The last
+// line per scenario ("BENCH ...") is meant for diffing between runs.
+
+#include "Logger.h"
+#include "MachineController.h"
+#include "SimHal.h"
+#include <chrono>
+#include <new>
+
+static uint32_t allocCount = 0;
+static uint64_t allocBytes = 0;
+
+void *operator new(size_t n) {
+  allocCount++;
+  allocBytes += n;
+  void *p = malloc(n ? n : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+#define BENCH_ORDER_MAX_MS (10UL * 60UL * 1000UL)
+#define BENCH_CUP_SWAP_MS 3000 // Operator: old cup out, new cup in
+#define HIST_BINS 12           // <1us, <2us, .. <1024us, >=1024us
+
+struct Tick {
+  uint32_t calls;
+  uint64_t totalNs;
+  uint64_t maxNs;
+  uint32_t hist[HIST_BINS];
+};
+
+struct Machine {
+  SimHal hal;
+  SensorTask sensors;
+  SettingsManager settings;
+  MachineController fsm;
+  SensorSnapshot seen; // What the last update() saw
+  unsigned long nextPollMs;
+
+  Machine() : sensors(hal), fsm(hal, sensors, settings), nextPollMs(0) {
+    hal.begin();
+    settings.begin();
+    sensors.poll();
+    sensors.read(seen);
+  }
+};
+
+static void runUpdate(Machine &m, Tick &t) {
+  auto t0 = std::chrono::steady_clock::now();
+  m.fsm.update();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - t0)
+                .count();
+  t.calls++;
+  t.totalNs += ns;
+  if ((uint64_t)ns > t.maxNs)
+    t.maxNs = ns;
+  uint8_t bin = 0;
+  for (uint64_t us = ns / 1000; us > 0 && bin < HIST_BINS - 1; us >>= 1)
+    bin++;
+  t.hist[bin]++;
+}
+
+// One simulated millisecond, update() if the controller is due
+static void tick(Machine &m, Tick &t, bool kick) {
+  m.hal.step(1);
+  simAdvanceUs(1000);
+  unsigned long now = millis();
+
+  if ((long)(now - m.nextPollMs) >= 0) {
+    m.sensors.poll();
+    m.nextPollMs = now + (m.fsm.isPowerSave() ? SENSOR_TASK_IDLE_PERIOD_MS
+                                              : DEBOUNCE_INTERVAL_MS);
+  }
+  SensorSnapshot s;
+  m.sensors.read(s);
+  if (!kick && !m.fsm.wakeDue(now, m.seen, s))
+    return;
+  m.seen = s;
+  runUpdate(m, t);
+}
+
+static OrderParams order(DrinkMode mode) {
+  OrderParams o;
+  memset(&o, 0, sizeof(o));
+  o.mode = mode;
+  o.brewBase = BREW_WATER;
+  o.hotLiquid = LIQUID_WATER;
+  o.milkRatio = RATIO_MEDIUM;
+  o.size = SIZE_SINGLE;
+  o.sugar = SUGAR_MEDIUM;
+  o.cleanWater = true;
+  return o;
+}
+
+struct Scenario {
+  const char *name;
+  OrderParams orders[3];
+  uint8_t count;        // Submitted back to back, the rest queue
+  unsigned long pullAt; // Cup removed this long after start (0 = never)
+  bool coldStart;       // Fresh machine (block at ambient), else keep-warm
+                        // state left by the previous scenario
+  unsigned long splashEvery; // One stray no-cup ping this often (0 = never)
+};
+
+static void runScenario(const Scenario &sc, Machine *&m) {
+  if (sc.coldStart || !m) {
+    delete m;
+    m = new Machine();
+  }
+  Tick t;
+  memset(&t, 0, sizeof(t));
+  m->hal.placeCup();
+  for (int i = 0; i < 2000; i++) // Cup settles, controller idles
+    tick(*m, t, false);
+  memset(&t, 0, sizeof(t));
+
+  float wh0 = m->fsm.heaterEnergyWh();
+  float water0 = m->hal.waterMl(), milk0 = m->hal.milkMl();
+  uint32_t sw0 = m->hal.relaySwitches();
+  uint32_t alloc0 = allocCount;
+  uint64_t bytes0 = allocBytes;
+  uint32_t logOld = logHeadSeq();
+  unsigned long t0 = millis();
+
+  uint8_t accepted = 0;
+  for (uint8_t i = 0; i < sc.count; i++)
+    accepted += m->fsm.submit(sc.orders[i]) != 0;
+
+  uint8_t finished = 0;
+  bool wasBusy = false;
+  unsigned long idleAt = 0;
+  const char *error = "";
+  bool kick = true; // submit() wants update() at once
+  while (millis() - t0 < BENCH_ORDER_MAX_MS * sc.count) {
+    unsigned long now = millis();
+    if (sc.pullAt && now - t0 == sc.pullAt)
+      m->hal.removeCup();
+    if (sc.splashEvery && (now - t0) % sc.splashEvery == 0)
+      m->hal.splash();
+    tick(*m, t, kick);
+    kick = false;
+
+    bool busy = m->fsm.isBusy();
+    if (wasBusy && !busy) {
+      finished++;
+      if (*m->fsm.getError() && !*error)
+        error = m->fsm.getError(); // Queued orders must still follow
+      idleAt = now;
+      m->hal.removeCup();
+    }
+    wasBusy = busy;
+    if (finished == accepted)
+      break;
+    if (!busy && idleAt && now - idleAt == BENCH_CUP_SWAP_MS)
+      m->hal.placeCup(); // Next queued order starts once it settles
+  }
+  unsigned long ms = millis() - t0;
+  if (finished < accepted)
+    error = "TIMEOUT";
+  if (*error)
+    m->fsm.stop();
+
+  uint32_t allocs = allocCount - alloc0;
+  printf("\n== %s: %u order(s) %s in %.1fs (sim)\n", sc.name, accepted,
+         *error ? error : "done", ms / 1000.0f);
+  printf("   heater %.2fWh, water %.0fmL, milk %.0fmL, %u relay switches\n",
+         m->fsm.heaterEnergyWh() - wh0, m->hal.waterMl() - water0,
+         m->hal.milkMl() - milk0, m->hal.relaySwitches() - sw0);
+  printf("   update(): %u calls (%.1f/s), mean %.2fus, max %.2fus\n", t.calls,
+         t.calls * 1000.0f / (ms ? ms : 1),
+         t.calls ? t.totalNs / 1000.0 / t.calls : 0.0, t.maxNs / 1000.0);
+  printf("   us:");
+  for (uint8_t b = 0; b < HIST_BINS; b++) {
+    if (b == HIST_BINS - 1)
+      printf(" >=%u:%u", 1u << (b - 1), t.hist[b]);
+    else
+      printf(" <%u:%u", 1u << b, t.hist[b]);
+  }
+  printf("\n   allocations: %u (%llu bytes)\n", allocs,
+         (unsigned long long)(allocBytes - bytes0));
+
+  LogEntry e; // Warnings/errors logged during the scenario
+  for (uint32_t seq = logOld + 1; seq <= logHeadSeq(); seq++) {
+    if (logRead(seq, e) && e.level <= LOG_LEVEL_WARN)
+      printf("   [%lu][%s][%s] %s\n", (unsigned long)(e.ms - t0),
+             LOG_LEVEL_NAMES[e.level], e.module, e.msg);
+  }
+
+  printf("BENCH name=%s result=%s ms=%lu calls=%u mean_ns=%llu max_ns=%llu "
+         "allocs=%u wh=%.3f\n",
+         sc.name, *error ? error : "ok", ms, t.calls,
+         (unsigned long long)(t.calls ? t.totalNs / t.calls : 0),
+         (unsigned long long)t.maxNs, allocs, m->fsm.heaterEnergyWh() - wh0);
+}
+
+int main() {
+  OrderParams milkCoffee = order(MODE_COFFEE);
+  milkCoffee.brewBase = BREW_MILK;
+  milkCoffee.size = SIZE_DOUBLE;
+  OrderParams hotMilk = order(MODE_HOTWATER);
+  hotMilk.hotLiquid = LIQUID_MILK_MEDIUM;
+
+  // clang-format off
+  const Scenario scenarios[] = {
+      {"coffee",           {order(MODE_COFFEE)},   1, 0,    true,  0},
+      {"coffee_milk_dbl",  {milkCoffee},           1, 0,    false, 0},
+      {"hotwater_cold",    {order(MODE_HOTWATER)}, 1, 0,    true,  0},
+      {"hotwater_warm",    {order(MODE_HOTWATER)}, 1, 0,    false, 0},
+      {"hotmilk",          {hotMilk},              1, 0,    false, 0},
+      {"nescafe",          {order(MODE_NESCAFE)},  1, 0,    false, 0},
+      {"cleaning",         {order(MODE_CLEANING)}, 1, 0,    false, 0},
+      {"queue_3_hotwater", {order(MODE_HOTWATER), order(MODE_HOTWATER),
+                            order(MODE_HOTWATER)}, 3, 0,    true,  0},
+      {"cup_pulled",       {order(MODE_COFFEE)},   1, 8000, true,  0},
+      {"abort_queued",     {order(MODE_COFFEE), order(MODE_HOTWATER),
+                            order(MODE_HOTWATER)}, 3, 8000, true,  0},
+      {"cup_splashes",     {order(MODE_COFFEE)},   1, 0,    true,  700},
+  };
+  // clang-format on
+
+  logSetLevel("*", LOG_LEVEL_INFO);
+  Machine *m = nullptr;
+  for (const Scenario &sc : scenarios)
+    runScenario(sc, m);
+  delete m;
+  return 0;
+}
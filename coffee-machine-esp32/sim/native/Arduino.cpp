@@ -0,0 +1,31 @@
+#include "Arduino.h"
+#include <stdarg.h>
+
+HardwareSerial Serial;
+
+static uint64_t nowUs = 0;
+static uint32_t cpuMhz = 240;
+
+unsigned long millis() { return (unsigned long)(nowUs / 1000); }
+unsigned long micros() { return (unsigned long)nowUs; }
+uint64_t simMicros() { return nowUs; }
+void simAdvanceUs(uint32_t us) { nowUs += us; }
+
+void setCpuFrequencyMhz(uint32_t mhz) { cpuMhz = mhz; }
+uint32_t getCpuFrequencyMhz() { return cpuMhz; }
+
+int HardwareSerial::printf(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vprintf(fmt, ap);
+  va_end(ap);
+  return n;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t,
+                                   void *, UBaseType_t, TaskHandle_t *out,
+                                   BaseType_t) {
+  if (out)
+    *out = nullptr;
+  return pdFAIL;
+}
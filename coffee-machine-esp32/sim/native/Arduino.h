@@ -0,0 +1,77 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Native build (platformio.ini env:native): the part of Arduino-ESP32 and
+// FreeRTOS the controller sources use, running on a simulated clock. No task
+// is ever started; the benchmark polls SensorTask itself and LOG_* lines only
+// go to the ring (no drain task).
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <strings.h>
+
+using std::max;
+using std::min;
+
+#define HIGH 1
+#define LOW 0
+#define PI 3.1415926535897932384626433832795
+
+// Simulated time: only simAdvanceUs() moves it
+unsigned long millis();
+unsigned long micros();
+uint64_t simMicros();
+void simAdvanceUs(uint32_t us);
+
+void setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+class String {
+public:
+  String(const char *s = "") : str(s ? s : "") {}
+  const char *c_str() const { return str.c_str(); }
+  unsigned int length() const { return str.size(); }
+
+private:
+  std::string str;
+};
+
+class HardwareSerial {
+public:
+  int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+extern HardwareSerial Serial;
+
+// FreeRTOS: creating a task fails, notifications are dropped
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *out,
+                                   BaseType_t core);
+inline void xTaskNotifyGive(TaskHandle_t) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline TickType_t xTaskGetTickCount() { return (TickType_t)millis(); }
+inline void vTaskDelayUntil(TickType_t *, TickType_t) {}
+
+typedef int portMUX_TYPE; // Single-threaded: critical sections are no-ops
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif
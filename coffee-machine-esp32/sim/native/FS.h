@@ -0,0 +1,39 @@
+#ifndef SIM_FS_H
+#define SIM_FS_H
+
+#include <stdio.h>
+#include <string>
+
+// Host files for the native build, enough for RecipeBook::load() (ArduinoJson
+// reads through read()/readBytes()).
+class File {
+public:
+  explicit File(FILE *f = nullptr) : f(f) {}
+  explicit operator bool() const { return f != nullptr; }
+  int read() { return f ? fgetc(f) : -1; }
+  size_t readBytes(char *buf, size_t len) { return f ? fread(buf, 1, len, f) : 0; }
+  void close() {
+    if (f)
+      fclose(f);
+    f = nullptr;
+  }
+
+private:
+  FILE *f;
+};
+
+namespace fs {
+// Paths are taken relative to root (e.g. the project's data/ directory)
+class FS {
+public:
+  explicit FS(const char *root) : root(root) {}
+  File open(const char *path, const char *mode) {
+    return File(fopen((root + path).c_str(), mode));
+  }
+
+private:
+  std::string root;
+};
+} // namespace fs
+
+#endif
@@ -0,0 +1,66 @@
+#include "Preferences.h"
+#include <string.h>
+
+static std::map<std::string, std::vector<uint8_t>> store;
+
+uint32_t Preferences::writes = 0;
+
+bool Preferences::begin(const char *name, bool ro) {
+  ns = std::string(name) + "/";
+  readOnly = ro;
+  return true;
+}
+
+std::vector<uint8_t> *Preferences::find(const char *key) {
+  auto it = store.find(ns + key);
+  return it == store.end() ? nullptr : &it->second;
+}
+
+bool Preferences::isKey(const char *key) { return find(key) != nullptr; }
+
+bool Preferences::remove(const char *key) {
+  return !readOnly && store.erase(ns + key) > 0;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  std::vector<uint8_t> *v = find(key);
+  return v ? v->size() : 0;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  std::vector<uint8_t> *v = find(key);
+  if (!v || v->size() > maxLen)
+    return 0;
+  memcpy(buf, v->data(), v->size());
+  return v->size();
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  if (readOnly)
+    return 0;
+  const uint8_t *p = (const uint8_t *)value;
+  store[ns + key].assign(p, p + len);
+  writes++;
+  return len;
+}
+
+// Scalars are stored as their raw bytes, like putBytes()
+template <typename T> static T getScalar(std::vector<uint8_t> *v, T fallback) {
+  if (!v || v->size() != sizeof(T))
+    return fallback;
+  T out;
+  memcpy(&out, v->data(), sizeof(T));
+  return out;
+}
+
+int32_t Preferences::getInt(const char *key, int32_t defaultValue) {
+  return getScalar(find(key), defaultValue);
+}
+
+float Preferences::getFloat(const char *key, float defaultValue) {
+  return getScalar(find(key), defaultValue);
+}
+
+bool Preferences::getBool(const char *key, bool defaultValue) {
+  return getScalar(find(key), defaultValue);
+}
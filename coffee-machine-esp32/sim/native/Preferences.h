@@ -0,0 +1,35 @@
+#ifndef SIM_PREFERENCES_H
+#define SIM_PREFERENCES_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// NVS in RAM for the native build: one store shared by all instances, kept
+// for the life of the process (a controller rebuilt in the same run sees the
+// settings the previous one committed).
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end() {}
+
+  bool isKey(const char *key);
+  bool remove(const char *key);
+  size_t getBytesLength(const char *key);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  size_t putBytes(const char *key, const void *value, size_t len);
+  int32_t getInt(const char *key, int32_t defaultValue = 0);
+  float getFloat(const char *key, float defaultValue = 0);
+  bool getBool(const char *key, bool defaultValue = false);
+
+  static uint32_t writes; // putBytes() calls, all instances
+
+private:
+  std::string ns;
+  bool readOnly = false;
+
+  std::vector<uint8_t> *find(const char *key);
+};
+
+#endif
@@ -0,0 +1,1017 @@
+#include "Api.h"
+#include "../core/Logger.h"
+#include "AppConfig.h"
+#include "Audio.h"
+#include "CaptiveDns.h"
+#include "Consumables.h"
+#include "Http.h"
+#include "Machine.h"
+#include "Mqtt.h"
+#include "OrderStats.h"
+#include "Perf.h"
+#include "StatusPush.h"
+#include "Storage.h"
+#include "Trace.h"
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+
+// LOG_*() only formats into a RAM ring slot; a low-priority task (logBegin())
+// prints "[ms][LEVEL][MODULE] msg", so the caller never waits on the UART.
+// GET /api/logs?since=<seq> reads the same ring. DEBUG calls compile to
+// nothing unless LOG_COMPILE_LEVEL is raised; per-module runtime levels are
+// set with POST /api/logs.
+
+// Modules POST /api/logs accepts and reports: the firmware's (src/app), then the core's
+static const char* const LOG_MODULE_NAMES[] = {
+  "BOOT", "NET", "API", "HTTP", "FSM", "HW", "SETTINGS", "AUDIO", "PERF",
+  "HAL", "MAX6675", "POWER", "RECIPE", "SENSORS"
+};
+static const int LOG_MODULE_COUNT = sizeof(LOG_MODULE_NAMES) / sizeof(LOG_MODULE_NAMES[0]);
+
+static uint32_t g_lastStatusLogMs = 0;
+
+static int clampInt(int v, int mn, int mx) {
+  if (v < mn) return mn;
+  if (v > mx) return mx;
+  return v;
+}
+
+
+void fillStatusJson(JsonDocument& d) {
+  SensorSnapshot snap;
+  g_sensors.read(snap);
+
+  d["isBusy"] = g_machine.isBusy();
+  d["state"] = g_machine.getState();
+  d["step"] = g_machine.getStep();
+  d["cupPresent"] = snap.cupPresent;
+  d["cupConfidence"] = snap.cupConfidence;
+  if (isnan(snap.intTemp)) d["intTemp"] = nullptr;
+  else d["intTemp"] = snap.intTemp;
+  d["error"] = machineError(); // nullptr serializes as null
+
+  d["keepWarm"] = !g_machine.isKeepingWarm() ? "off" : (g_machine.isPredictivePreheat() ? "predict" : "standby");
+  d["powerSave"] = g_machine.isPowerSave();
+  d["energyWh"] = roundf(energyWh() * 100.0f) / 100.0f;
+  d["keepWarmWh"] = roundf(g_machine.keepWarmEnergyWh() * 100.0f) / 100.0f;
+
+  d["queue"] = g_machine.queueSize();
+
+  // Overlapped drink phases currently running (state/step show the leading one)
+  JsonArray phases = d.createNestedArray("phases");
+  uint16_t running = g_machine.runningPhases();
+  for (uint8_t i = 0; i < PH_COUNT; i++) {
+    if (running & (1u << i)) phases.add(g_machine.phaseName(i));
+  }
+}
+
+static void apiStatus() {
+  // Optional log, rate-limited
+  uint32_t now = millis();
+  if (now - g_lastStatusLogMs >= STATUS_LOG_MIN_MS) {
+    g_lastStatusLogMs = now;
+    // Do NOT spam. This is enough.
+    SensorSnapshot snap;
+    g_sensors.read(snap);
+    const char* err = machineError();
+    LOG_INFOF("API", "GET /api/status | isBusy=%s state=%s cup=%d%s%s",
+          g_machine.isBusy() ? "true" : "false", g_machine.getState(), snap.cupPresent ? 1 : 0,
+          err ? " error=" : "", err ? err : "");
+  }
+
+  StaticJsonDocument<512> d;
+  fillStatusJson(d);
+  sendJsonOkObject(d);
+}
+
+static void apiGetSettings() {
+  const Settings& s = g_settings.get();
+  StaticJsonDocument<512> d;
+  d["tank1Time"] = s.tank1Time;
+  d["tank2Time"] = s.tank2Time;
+  d["tank3Time"] = s.tank3Time;
+  d["waterPumpTime"] = s.waterPumpTime;
+  d["milkPumpTime"] = s.milkPumpTime;
+  d["intHeaterTime"] = s.intHeaterTime;
+  d["intHeaterTemp"] = s.intHeaterTemp;
+  d["extHeaterTime"] = s.extHeaterTime;
+  d["extHeaterTemp"] = s.extHeaterTemp; // accepted but ignored
+  d["mixerTime"] = s.mixerTime;
+  d["audioVolume"] = s.audioVolume;
+  d["audioMuted"] = s.audioMuted;
+  d["pidKp"] = s.pidKp;
+  d["pidKi"] = s.pidKi;
+  d["pidKd"] = s.pidKd;
+  d["pidFf"] = s.pidFf;
+  d["powerBudgetW"] = s.powerBudgetW;
+  d["standbyTemp"] = s.standbyTemp;
+  d["standbyMin"] = s.standbyMin;
+  d["predictPreheat"] = s.predictPreheat;
+  sendJsonOkObject(d);
+}
+
+// Parses the body into the shared g_reqDoc arena (valid until the next request).
+static bool readJsonBody() {
+  g_reqDoc.clear();
+  return httpParseBody(g_reqDoc);
+}
+
+static void apiPostSettings() {
+  LOG_INFO("API", "POST /api/settings");
+
+  if (!readJsonBody()) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  JsonDocument& doc = g_reqDoc;
+
+  Settings s = g_settings.get(); // start from current
+  bool any = false;
+
+  auto updInt = [&](const char* key, int& field, int mn, int mx) -> bool {
+    if (!doc.containsKey(key)) return true;
+    any = true;
+    int v = doc[key].as<int>();
+    if (v < mn || v > mx) {
+      char reason[32];
+      snprintf(reason, sizeof(reason), "Out of range [%d..%d]", mn, mx);
+      StaticJsonDocument<128> data;
+      data["field"] = key;    // const char*: stored by pointer
+      data["reason"] = reason; // char[]: copied into the document
+      sendJsonEnvelope(200, false, &data, "INVALID_VALUE");
+      return false;
+    }
+    field = v;
+    return true;
+  };
+
+  auto updFloat = [&](const char* key, float& field, float mn, float mx) -> bool {
+    if (!doc.containsKey(key)) return true;
+    any = true;
+    float v = doc[key].as<float>();
+    if (isnan(v) || v < mn || v > mx) {
+      char reason[40];
+      snprintf(reason, sizeof(reason), "Out of range [%g..%g]", mn, mx);
+      StaticJsonDocument<128> data;
+      data["field"] = key;
+      data["reason"] = reason;
+      sendJsonEnvelope(200, false, &data, "INVALID_VALUE");
+      return false;
+    }
+    field = v;
+    return true;
+  };
+
+  auto updBool = [&](const char* key, bool& field) -> bool {
+    if (!doc.containsKey(key)) return true;
+    any = true;
+    field = doc[key].as<bool>();
+    return true;
+  };
+
+  if (!updInt("tank1Time", s.tank1Time, 0, 30)) return;
+  if (!updInt("tank2Time", s.tank2Time, 0, 30)) return;
+  if (!updInt("tank3Time", s.tank3Time, 0, 30)) return;
+  if (!updInt("waterPumpTime", s.waterPumpTime, 0, 60)) return;
+  if (!updInt("milkPumpTime", s.milkPumpTime, 0, 60)) return;
+  if (!updInt("intHeaterTime", s.intHeaterTime, 10, 120)) return;
+  if (!updInt("intHeaterTemp", s.intHeaterTemp, 60, 100)) return;
+  if (!updInt("extHeaterTime", s.extHeaterTime, 10, 180)) return;
+  if (!updInt("extHeaterTemp", s.extHeaterTemp, 60, 100)) return; // accepted but ignored
+  if (!updInt("mixerTime", s.mixerTime, 5, 60)) return;
+  if (!updInt("audioVolume", s.audioVolume, 0, 100)) return;
+  if (!updBool("audioMuted", s.audioMuted)) return;
+  if (!updFloat("pidKp", s.pidKp, 0.0f, 50.0f)) return;
+  if (!updFloat("pidKi", s.pidKi, 0.0f, 5.0f)) return;
+  if (!updFloat("pidKd", s.pidKd, 0.0f, 200.0f)) return;
+  if (!updFloat("pidFf", s.pidFf, 0.0f, 100.0f)) return;
+  if (!updInt("powerBudgetW", s.powerBudgetW, 100, 4000)) return;
+  if (!updInt("standbyTemp", s.standbyTemp, 40, 95)) return;
+  if (!updInt("standbyMin", s.standbyMin, 0, 120)) return;
+  if (!updBool("predictPreheat", s.predictPreheat)) return;
+
+  if (!any) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+
+  g_settings.save(s); // in range: checked field by field above
+
+  // Queue the new volume for the DFPlayer task
+  audioApplyFromSettings();
+
+  StaticJsonDocument<64> ok;
+  ok["message"] = "Settings saved";
+  sendJsonOkObject(ok);
+}
+
+void apiStop() {
+  LOG_INFO("API", "POST /api/stop");
+
+  g_machine.stop(); // relays off, keep-warm disarmed, error cleared; the queue stays
+  g_mqttOrderStopped = true;
+
+  StaticJsonDocument<64> d;
+  d["message"] = "Stopped";
+  sendJsonOkObject(d);
+}
+
+static void apiAudio() {
+  LOG_INFO("API", "POST /api/audio");
+
+  if (!readJsonBody()) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  JsonDocument& doc = g_reqDoc;
+
+  Settings s = g_settings.get();
+  bool changed = false;
+  if (doc.containsKey("volume")) {
+    s.audioVolume = clampInt(doc["volume"].as<int>(), 0, 100);
+    changed = true;
+  }
+  if (doc.containsKey("muted")) {
+    s.audioMuted = doc["muted"].as<bool>();
+    changed = true;
+  }
+
+  if (!changed) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+
+  g_settings.save(s); // slider drags coalesce into one write
+  audioApplyFromSettings();
+
+  StaticJsonDocument<128> d;
+  d["audioVolume"] = g_settings.get().audioVolume;
+  d["audioMuted"] = g_settings.get().audioMuted;
+  sendJsonOkObject(d);
+}
+
+void apiStart() {
+  LOG_INFO("API", "POST /api/start");
+
+  if (!readJsonBody()) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  JsonDocument& doc = g_reqDoc;
+
+  // Parse mode
+  if (!doc.containsKey("mode")) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+
+  // "Hot Water" / "Nescafé" are tolerated for older UIs
+  char modeBuf[16];
+  size_t n = 0;
+  for (const char* c = doc["mode"].as<const char*>(); c && *c && n + 1 < sizeof(modeBuf); c++) {
+    if (*c == ' ') continue;
+    if ((uint8_t)c[0] == 0xC3 && (uint8_t)c[1] == 0xA9) { modeBuf[n++] = 'e'; c++; continue; } // é
+    modeBuf[n++] = *c;
+  }
+  modeBuf[n] = '\0';
+
+  // Built-in drinks first, then the custom ones from RECIPES_PATH
+  OrderParams o;
+  o.mode = (DrinkMode)parseEnumName(modeBuf, DRINK_MODE_NAMES, MODE_CUSTOM, MODE_NONE);
+  o.recipe = 0;
+  if (o.mode == MODE_NONE) {
+    int custom = g_machine.recipes().find(modeBuf);
+    if (custom < 0) {
+      sendJsonError("BAD_MODE");
+      return;
+    }
+    o.mode = MODE_CUSTOM;
+    o.recipe = (uint8_t)custom;
+  }
+
+  // Unknown option values fall back to the default, as before
+  o.brewBase  = (BrewBase)parseEnumName(doc["brewBase"].as<const char*>(), BREW_BASE_NAMES, BREW_MILK + 1, BREW_WATER);
+  o.size      = (CupSize)parseEnumName(doc["size"].as<const char*>(), CUP_SIZE_NAMES, SIZE_DOUBLE + 1, SIZE_SINGLE);
+  o.sugar     = (SugarLevel)parseEnumName(doc["sugar"].as<const char*>(), SUGAR_LEVEL_NAMES, SUGAR_HIGH + 1, SUGAR_MEDIUM);
+  o.hotLiquid = (HotLiquid)parseEnumName(doc["hotLiquid"].as<const char*>(), HOT_LIQUID_NAMES, LIQUID_MILK_EXTRA + 1,
+                                         LIQUID_WATER);
+  o.milkRatio = (MilkRatio)parseEnumName(doc["milkRatio"].as<const char*>(), MILK_RATIO_NAMES, RATIO_EXTRA + 1, RATIO_NONE);
+  o.cleanWater = doc.containsKey("cleanWater") ? doc["cleanWater"].as<bool>() : false;
+  o.cleanMilk  = doc.containsKey("cleanMilk")  ? doc["cleanMilk"].as<bool>() : false;
+
+  if (o.mode == MODE_CLEANING && !o.cleanMilk && !o.cleanWater) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+
+  // Log order summary
+  switch (o.mode) {
+    case MODE_COFFEE:
+      LOG_INFOF("API", "Start | mode=%s brewBase=%s size=%s sugar=%s", g_machine.recipeFor(o).name,
+            BREW_BASE_NAMES[o.brewBase], CUP_SIZE_NAMES[o.size], SUGAR_LEVEL_NAMES[o.sugar]);
+      break;
+    case MODE_HOTWATER:
+      LOG_INFOF("API", "Start | mode=%s hotLiquid=%s size=%s sugar=%s", g_machine.recipeFor(o).name,
+            HOT_LIQUID_NAMES[o.hotLiquid], CUP_SIZE_NAMES[o.size], SUGAR_LEVEL_NAMES[o.sugar]);
+      break;
+    case MODE_NESCAFE:
+      LOG_INFOF("API", "Start | mode=%s milkRatio=%s size=%s sugar=%s", g_machine.recipeFor(o).name,
+            MILK_RATIO_NAMES[o.milkRatio], CUP_SIZE_NAMES[o.size], SUGAR_LEVEL_NAMES[o.sugar]);
+      break;
+    case MODE_CLEANING:
+      LOG_INFOF("API", "Start | mode=%s cleanWater=%d cleanMilk=%d size=%s sugar=%s", g_machine.recipeFor(o).name,
+            o.cleanWater ? 1 : 0, o.cleanMilk ? 1 : 0, CUP_SIZE_NAMES[o.size], SUGAR_LEVEL_NAMES[o.sugar]);
+      break;
+    default: // custom recipe: any option may be used by its guards/scales
+      LOG_INFOF("API", "Start | mode=%s cleanWater=%d cleanMilk=%d brewBase=%s hotLiquid=%s milkRatio=%s size=%s sugar=%s",
+            g_machine.recipeFor(o).name,
+            o.cleanWater ? 1 : 0, o.cleanMilk ? 1 : 0, BREW_BASE_NAMES[o.brewBase], HOT_LIQUID_NAMES[o.hotLiquid],
+            MILK_RATIO_NAMES[o.milkRatio], CUP_SIZE_NAMES[o.size], SUGAR_LEVEL_NAMES[o.sugar]);
+      break;
+  }
+
+  // Busy, a non-empty queue, or no cup: the controller queues it (starts on
+  // cup placement)
+  uint16_t id = g_machine.submit(o);
+  if (id == 0) {
+    sendJsonError(g_machine.getError()); // QUEUE_FULL, NOT_READY
+    LOG_WARNF("API", "Start rejected: %s", g_machine.getError());
+    return;
+  }
+  int pos = g_machine.queuePosition(id);
+  if (pos >= 0) {
+    SensorSnapshot snap;
+    g_sensors.read(snap);
+    StaticJsonDocument<128> d;
+    d["message"] = "Queued";
+    d["id"] = id;
+    d["position"] = pos;
+    d["waitSec"] = g_machine.waitMs((uint8_t)pos) / 1000;
+    d["cupPresent"] = snap.cupPresent;
+    sendJsonOkObject(d);
+    LOG_INFOF("API", "Queued | id=%u position=%d", id, pos);
+    return;
+  }
+
+  StaticJsonDocument<128> d;
+  d["message"] = "Cycle started";
+  d["id"] = id;
+  d["durationSec"] = g_machine.estimateMs(o) / 1000;
+  sendJsonOkObject(d);
+}
+
+// GET /api/queue: waiting orders in start order, each with its estimated wait
+static void apiGetQueue() {
+  StaticJsonDocument<1024> d;
+  d["max"] = ORDER_QUEUE_MAX;
+  d["currentSec"] = g_machine.remainingMs() / 1000;
+  JsonArray items = d.createNestedArray("items");
+  for (uint8_t i = 0; i < g_machine.queueSize(); i++) {
+    const QueuedOrder& q = g_machine.queuedAt(i);
+    JsonObject it = items.createNestedObject();
+    it["id"] = q.id;
+    it["mode"] = g_machine.recipeFor(q.order).name;
+    it["waitSec"] = g_machine.waitMs(i) / 1000;
+    it["durationSec"] = g_machine.estimateMs(q.order) / 1000;
+  }
+  sendJsonOkObject(d);
+}
+
+// POST /api/queue: {"action":"cancel","id":N} | {"action":"move","id":N,"to":P}
+// | {"action":"clear"}. Positions are 0-based; the running order is not
+// in the queue (use /api/stop).
+static void apiPostQueue() {
+  LOG_INFO("API", "POST /api/queue");
+  if (!readJsonBody()) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  JsonDocument& doc = g_reqDoc;
+  const char* action = doc["action"].as<const char*>();
+  if (!action) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+
+  if (strcmp(action, "clear") == 0) {
+    LOG_INFOF("API", "Queue clear | %u dropped", g_machine.queueSize());
+    g_machine.clearQueue();
+    g_statusDirty = true;
+    apiGetQueue();
+    return;
+  }
+
+  uint16_t id = doc.containsKey("id") ? doc["id"].as<uint16_t>() : 0;
+  if (g_machine.queuePosition(id) < 0) {
+    sendJsonError("NOT_FOUND");
+    return;
+  }
+
+  if (strcmp(action, "cancel") == 0) {
+    g_machine.cancelQueued(id);
+    LOG_INFOF("API", "Queue cancel | id=%u", id);
+  } else if (strcmp(action, "move") == 0 && doc.containsKey("to")) {
+    int to = doc["to"].as<int>();
+    g_machine.moveQueued(id, (uint8_t)(to < 0 ? 0 : (to > 255 ? 255 : to)));
+    LOG_INFOF("API", "Queue move | id=%u to=%d", id, to);
+  } else {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  apiGetQueue();
+}
+
+// GET /api/recipes: drinks accepted as /api/start "mode", built-ins first
+static void apiGetRecipes() {
+  StaticJsonDocument<512> d;
+  d["customMax"] = CUSTOM_RECIPE_MAX;
+  JsonArray items = d.createNestedArray("items");
+  OrderParams o = {};
+  for (uint8_t m = MODE_COFFEE; m <= MODE_CUSTOM; m++) {
+    uint8_t count = m == MODE_CUSTOM ? g_machine.recipes().size() : 1;
+    for (uint8_t i = 0; i < count; i++) {
+      o.mode = (DrinkMode)m;
+      o.recipe = i;
+      const Recipe& r = g_machine.recipeFor(o);
+      JsonObject it = items.createNestedObject();
+      it["name"] = r.name;
+      it["steps"] = r.count;
+      it["custom"] = m == MODE_CUSTOM;
+    }
+  }
+  sendJsonOkObject(d);
+}
+
+// POST /api/recipes {"action":"reload"}: re-read /recipes.json after an
+// upload. Refused while an order runs or waits, since orders keep the index.
+static void apiPostRecipes() {
+  LOG_INFO("API", "POST /api/recipes");
+  if (!readJsonBody()) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  const char* action = g_reqDoc["action"].as<const char*>();
+  if (!action || strcmp(action, "reload") != 0) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  if (g_machine.isBusy() || g_machine.queueSize() > 0) {
+    sendJsonError("BUSY");
+    return;
+  }
+  if (fsReady()) g_machine.loadRecipes(LittleFS); // built-ins only until LittleFS is mounted
+  apiGetRecipes();
+}
+
+// POST /api/heater/autotune: characterise the thermoblock (no cup, no pump).
+// Runs until done (state DONE, gains saved) or /api/stop.
+static void apiAutotune() {
+  LOG_INFO("API", "POST /api/heater/autotune");
+  if (g_machine.isBusy() || !g_machine.startAutoTune()) { // disarms keep-warm itself
+    sendJsonError("BUSY");
+    return;
+  }
+
+  StaticJsonDocument<64> d;
+  d["message"] = "Auto-tune started";
+  sendJsonOkObject(d);
+}
+
+// GET /api/logs?since=<seq>: entries newer than seq, oldest first, as many as
+// fit in one reply. "next" is the seq to pass on the following call; "dropped"
+// counts entries after since that the ring already overwrote. Replies larger
+// than g_jsonOut (sendJsonOkLarge) are framed here too.
+static char g_logsOut[4096];
+
+// Appends s as a JSON string body (no quotes); false if it does not fit.
+static bool jsonEscapeAppend(char* buf, size_t cap, size_t& n, const char* s) {
+  for (; *s; s++) {
+    char c = *s;
+    char esc[7];
+    const char* out = esc;
+    size_t len = 1;
+    if (c == '"' || c == '\\') { esc[0] = '\\'; esc[1] = c; len = 2; }
+    else if ((uint8_t)c < 0x20) len = snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)c);
+    else esc[0] = c;
+    if (n + len >= cap) return false;
+    memcpy(buf + n, out, len);
+    n += len;
+  }
+  return true;
+}
+
+// Tasks whose stack watermark /api/diag and the PERF dump report
+static const uint8_t PERF_TASK_COUNT = 6;
+
+static void perfTasks(const char** names, TaskHandle_t* tasks) {
+  names[0] = "loop";    tasks[0] = g_fsmTask;
+  names[1] = "sensors"; tasks[1] = g_sensors.task();
+  names[2] = "log";     tasks[2] = xTaskGetHandle("log"); // core Logger
+  names[3] = "dfplayer"; tasks[3] = g_dfTask;
+  names[4] = "dns";     tasks[4] = g_dnsTask;
+  names[5] = "async_tcp";
+#if USE_ASYNC_HTTP
+  tasks[5] = xTaskGetHandle("async_tcp");
+#else
+  tasks[5] = nullptr;
+#endif
+}
+
+// PERF log: heap, stack watermarks, then one line per slot that has run
+static void perfDump() {
+  LOG_INFOF("PERF", "heap free=%u min=%u big=%u",
+        (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+  const char* names[PERF_TASK_COUNT];
+  TaskHandle_t tasks[PERF_TASK_COUNT];
+  perfTasks(names, tasks);
+  char line[96];
+  size_t n = snprintf(line, sizeof(line), "stack free min:");
+  for (uint8_t i = 0; i < PERF_TASK_COUNT; i++) {
+    if (!tasks[i] || n >= sizeof(line)) continue;
+    n += snprintf(line + n, sizeof(line) - n, " %s=%u", names[i], (unsigned)uxTaskGetStackHighWaterMark(tasks[i]));
+  }
+  LOG_INFO("PERF", line);
+
+  PerfSummary p;
+  for (uint8_t id = 0; id < PERF_COUNT; id++) {
+    if (!perfSummary(id, p)) continue;
+    LOG_INFOF("PERF", "%s n=%lu us min=%.1f avg=%.1f p99=%.1f max=%.1f", perfName(id),
+          (unsigned long)p.count, p.minNs / 1000.0f, p.avgNs / 1000.0f, p.p99Ns / 1000.0f, p.maxNs / 1000.0f);
+  }
+}
+
+static uint32_t g_perfDumpMs = 0;
+
+void perfDumpIfDue(uint32_t now) {
+  if (PERF_DUMP_MS == 0 || now - g_perfDumpMs < PERF_DUMP_MS) return;
+  g_perfDumpMs = now;
+  perfDump();
+}
+
+static float perfUs(uint32_t ns) {
+  return (ns / 10) / 100.0f; // 2 decimals keep the reply short
+}
+
+// Document for the sendJsonOkLarge() replies (diag, consumables, stats). They
+// only run one at a time from handlers under CoreLock, so they share it
+// instead of allocating 2-6 KB from the heap per request.
+static StaticJsonDocument<6144> g_largeDoc;
+
+static JsonDocument& largeDocBegin() {
+  g_largeDoc.clear();
+  return g_largeDoc;
+}
+
+// sendJsonOkObject() for documents larger than g_jsonOut; false (and an
+// error reply) if it does not fit g_logsOut either.
+static bool sendJsonOkLarge(const JsonDocument& d, const char* what) {
+  static const char HEAD[] = "{\"ok\":true,\"data\":";
+  static const char TAIL[] = ",\"error\":null}";
+  size_t room = sizeof(g_logsOut) - (sizeof(HEAD) - 1) - sizeof(TAIL);
+  if (d.overflowed() || measureJson(d) >= room) {
+    LOG_ERRORF("HTTP", "%s reply too large", what);
+    sendJsonError("RESPONSE_TOO_LARGE");
+    return false;
+  }
+  size_t n = snprintf(g_logsOut, sizeof(g_logsOut), "%s", HEAD);
+  n += serializeJson(d, g_logsOut + n, sizeof(g_logsOut) - n);
+  n += snprintf(g_logsOut + n, sizeof(g_logsOut) - n, "%s", TAIL);
+  httpSendBuf(200, "application/json", g_logsOut, n);
+  return true;
+}
+
+// GET /api/diag[?reset=1]: boot breakdown (ms since reset per stage), heap and
+// stack watermarks, hot-path timing and the DFPlayer queue. "perfUs" maps each
+// timed call that has run to [count, min, avg, p99, max] in us; reset=1 clears
+// the timings after this reply.
+static void apiDiag() {
+  JsonDocument& d = largeDocBegin();
+  d["uptimeMs"] = millis();
+  d["cpuMhz"] = getCpuFrequencyMhz();
+  d["heapFree"] = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  d["heapMinFree"] = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  d["heapLargest"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+  JsonObject boot = d.createNestedObject("boot");
+  boot["readyMs"] = g_bootReadyUs / 1000.0f;
+  JsonArray stages = boot.createNestedArray("stages");
+  for (uint8_t i = 0; i < BOOT_STAGE_COUNT; i++) {
+    JsonObject st = stages.createNestedObject();
+    st["name"] = BOOT_STAGE_NAMES[i];
+    st["startMs"] = g_boot[i].startUs / 1000.0f;
+    if (g_boot[i].done) st["ms"] = g_boot[i].durUs / 1000.0f;
+    else st["ms"] = nullptr; // still running
+  }
+
+  const char* names[PERF_TASK_COUNT];
+  TaskHandle_t tasks[PERF_TASK_COUNT];
+  perfTasks(names, tasks);
+  JsonObject stack = d.createNestedObject("stackFreeMin"); // bytes
+  for (uint8_t i = 0; i < PERF_TASK_COUNT; i++) {
+    if (tasks[i]) stack[names[i]] = uxTaskGetStackHighWaterMark(tasks[i]);
+  }
+
+  JsonObject perf = d.createNestedObject("perfUs");
+  PerfSummary p;
+  for (uint8_t id = 0; id < PERF_COUNT; id++) {
+    if (!perfSummary(id, p)) continue;
+    JsonArray a = perf.createNestedArray((char*)perfName(id)); // copied: slot names are buffers
+    a.add(p.count);
+    a.add(perfUs(p.minNs));
+    a.add(perfUs(p.avgNs));
+    a.add(perfUs(p.p99Ns));
+    a.add(perfUs(p.maxNs));
+  }
+
+  JsonObject audio = d.createNestedObject("audio");
+  audio["ready"] = g_dfReady.load();
+  audio["acks"] = g_dfAcks;
+  audio["queued"] = g_dfQueue ? (uint32_t)uxQueueMessagesWaiting(g_dfQueue) : 0;
+  audio["dropped"] = g_dfDropped.load();
+  audio["failed"] = g_dfFailed.load();
+
+  JsonObject mqtt = d.createNestedObject("mqtt");
+  mqtt["enabled"] = STA_SSID[0] != 0;
+  mqtt["wifi"] = STA_SSID[0] != 0 && WiFi.status() == WL_CONNECTED;
+  mqtt["connected"] = g_mqttUp.load();
+  mqtt["backlog"] = g_mqttBacklogLen;
+  mqtt["ordersSent"] = g_mqttOrdersSent;
+  mqtt["ordersLost"] = g_mqttOrdersLost;
+  mqtt["cmdDropped"] = g_mqttCmdDropped.load();
+
+  JsonObject dns = d.createNestedObject("dns");
+  dns["answered"] = g_dnsAnswered.load();
+  dns["nxdomain"] = g_dnsNxdomain.load();
+  dns["limited"] = g_dnsLimited.load();
+  dns["malformed"] = g_dnsMalformed.load();
+  dns["errors"] = g_dnsErrors.load();
+
+  if (!sendJsonOkLarge(d, "/api/diag")) return;
+  if (httpArg("reset") == "1") perfReset();
+}
+
+// GET /api/consumables: stock per dispensing relay and the forecast. "remaining"
+// includes a relay that is on right now; "ordersLeft" divides it by the
+// per-order EWMA, "minutesLeft" paces that at the current order gap (null
+// outside a session of orders).
+static void apiGetConsumables() {
+  uint32_t now = millis();
+  JsonDocument& d = largeDocBegin();
+  d["orders"] = g_consOrders;
+  if (g_machine.orderGapMs() > 0.0f) d["orderGapS"] = roundf(g_machine.orderGapMs() / 100.0f) / 10.0f;
+  else d["orderGapS"] = nullptr;
+
+  JsonArray items = d.createNestedArray("items");
+  for (uint8_t i = 0; i < CONS_COUNT; i++) {
+    const Consumable& c = g_cons[i];
+    uint32_t extra = relayRunningMs(i, now);
+    float left = consumableRemaining(i, extra);
+    JsonObject o = items.createNestedObject();
+    o["name"] = CONS_NAMES[i];
+    o["unit"] = CONS_UNITS[i];
+    o["tracked"] = c.perSec > 0;
+    o["perSec"] = c.perSec;
+    o["capacity"] = c.capacity;
+    o["lowAt"] = c.lowAt;
+    o["remaining"] = roundf(left * 10.0f) / 10.0f;
+    o["low"] = consumableLow(i, extra);
+    o["runS"] = (c.runMs + extra) / 1000;
+    o["perOrder"] = roundf(c.perOrder * 10.0f) / 10.0f;
+    if (c.perSec > 0 && c.perOrder > 0.01f) {
+      float orders = left > 0 ? left / c.perOrder : 0.0f;
+      o["ordersLeft"] = (uint32_t)orders;
+      if (g_machine.orderGapMs() > 0.0f) o["minutesLeft"] = (uint32_t)(orders * g_machine.orderGapMs() / 60000.0f);
+      else o["minutesLeft"] = nullptr;
+    } else {
+      o["ordersLeft"] = nullptr;
+      o["minutesLeft"] = nullptr;
+    }
+  }
+  sendJsonOkLarge(d, "/api/consumables");
+}
+
+// POST /api/consumables
+//   {"refill":"coffee"|"*"[,"amount":300]}  stock is full (or amount) again
+//   {"name":"coffee","perSec":1.6,"capacity":600,"lowAt":90}  calibration
+// Changing perSec keeps the current remaining amount. Committed at once.
+static void apiPostConsumables() {
+  if (!readJsonBody()) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  JsonDocument& doc = g_reqDoc;
+  uint32_t now = millis();
+
+  const char* refill = doc["refill"].as<const char*>();
+  const char* name = refill ? refill : doc["name"].as<const char*>();
+  bool all = refill && strcmp(refill, "*") == 0;
+  int idx = all ? -1 : parseEnumName(name, CONS_NAMES, CONS_COUNT, -1);
+  if (!all && idx < 0) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+
+  if (refill) {
+    bool partial = doc.containsKey("amount"); // one consumable only
+    float amount = partial ? doc["amount"].as<float>() : 0.0f;
+    if (partial && (all || isnan(amount) || amount < 0 || amount > g_cons[idx].capacity)) {
+      sendJsonError("INVALID_VALUE");
+      return;
+    }
+    for (uint8_t i = 0; i < CONS_COUNT; i++) {
+      if (!all && i != idx) continue;
+      Consumable& c = g_cons[i];
+      if (relayRunningMs(i, now)) energyAccount(i, now); // counted against the old fill
+      c.refillRunMs = c.runMs;
+      c.fill = partial ? amount : c.capacity;
+      LOG_INFOF("API", "POST /api/consumables | refill %s %.0f%s", CONS_NAMES[i], c.fill, CONS_UNITS[i]);
+    }
+  } else {
+    Consumable& c = g_cons[idx];
+    float perSec = doc.containsKey("perSec") ? doc["perSec"].as<float>() : c.perSec;
+    float capacity = doc.containsKey("capacity") ? doc["capacity"].as<float>() : c.capacity;
+    float lowAt = doc.containsKey("lowAt") ? doc["lowAt"].as<float>() : c.lowAt;
+    if (isnan(perSec) || isnan(capacity) || isnan(lowAt) || perSec < 0 || perSec > 100 ||
+        capacity <= 0 || capacity > 100000 || lowAt < 0 || lowAt > capacity) {
+      sendJsonError("INVALID_VALUE");
+      return;
+    }
+    if (perSec != c.perSec) { // rebase: what is left stays left
+      if (relayRunningMs(idx, now)) energyAccount(idx, now);
+      c.fill = consumableRemaining((uint8_t)idx, 0);
+      c.refillRunMs = c.runMs;
+      c.perOrder = c.perSec > 0 ? c.perOrder * perSec / c.perSec : 0.0f;
+      c.perSec = perSec;
+    }
+    c.capacity = capacity;
+    c.lowAt = lowAt;
+    if (c.fill > capacity) c.fill = capacity;
+    LOG_INFOF("API", "POST /api/consumables | %s perSec=%.2f capacity=%.0f lowAt=%.0f",
+          CONS_NAMES[idx], c.perSec, c.capacity, c.lowAt);
+  }
+
+  consumablesUpdateLow();
+  consumablesCommit();
+  apiGetConsumables();
+}
+
+static void statsSeriesJson(JsonObject o, const StatsSeries& st) {
+  o["n"] = st.count;
+  o["avgS"] = st.count ? roundf((float)st.sumMs / st.count / 100.0f) / 10.0f : 0.0f;
+  JsonArray h = o.createNestedArray("hist");
+  for (uint8_t b = 0; b < STATS_BUCKETS; b++) h.add(st.hist[b]);
+}
+
+// GET /api/stats[?mode=Coffee]: per mode, results by code and the total time
+// of DONE orders as {n, avgS, hist}; hist[i] counts times up to bucketsS[i]
+// (null = the open last bucket). With ?mode= the one mode also gets the same
+// per state it showed (all modes at once would not fit one reply). "last" is
+// the most recent order.
+static void apiGetStats() {
+  String only = httpArg("mode");
+  int onlyMode = only.length() ? parseEnumName(only.c_str(), STATS_MODE_NAMES, STATS_MODES, -1) : -1;
+  if (only.length() && onlyMode < 0) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+
+  JsonDocument& d = largeDocBegin();
+  JsonArray buckets = d.createNestedArray("bucketsS");
+  for (uint8_t b = 0; b < STATS_BUCKETS - 1; b++) buckets.add(STATS_BUCKET_MS[b] / 1000);
+  buckets.add(nullptr);
+
+  JsonObject modes = d.createNestedObject("modes");
+  for (uint8_t m = 0; m < STATS_MODES; m++) {
+    if (onlyMode >= 0 && m != onlyMode) continue;
+    const ModeStats& ms = g_statsBlob.m[m];
+    uint32_t orders = 0;
+    for (uint8_t r = 0; r < STATS_RESULTS; r++) orders += ms.results[r];
+    if (orders == 0 && onlyMode < 0) continue;
+
+    JsonObject mo = modes.createNestedObject(STATS_MODE_NAMES[m]);
+    mo["orders"] = orders;
+    JsonObject res = mo.createNestedObject("results");
+    for (uint8_t r = 0; r < STATS_RESULTS; r++) {
+      if (ms.results[r]) res[STATS_RESULT_NAMES[r]] = ms.results[r];
+    }
+    statsSeriesJson(mo.createNestedObject("total"), ms.total);
+    if (onlyMode < 0) continue;
+    JsonObject ph = mo.createNestedObject("states");
+    for (uint8_t i = 0; i < STATS_PHASES; i++) {
+      if (ms.phase[i].count) statsSeriesJson(ph.createNestedObject(MachineController::stateName((MachineState)(VALIDATE + i))), ms.phase[i]);
+    }
+  }
+
+  if (g_statsLastResult < STATS_RESULTS) {
+    JsonObject last = d.createNestedObject("last");
+    last["mode"] = STATS_MODE_NAMES[g_statsLastMode];
+    last["result"] = STATS_RESULT_NAMES[g_statsLastResult];
+    last["totalMs"] = g_statsLastMs[STATS_PHASES];
+    JsonObject ph = last.createNestedObject("statesMs");
+    for (uint8_t i = 0; i < STATS_PHASES; i++) {
+      if (g_statsLastMs[i]) ph[MachineController::stateName((MachineState)(VALIDATE + i))] = g_statsLastMs[i];
+    }
+  } else {
+    d["last"] = nullptr;
+  }
+  sendJsonOkLarge(d, "/api/stats");
+}
+
+// POST /api/stats {"reset":true}: clears the histograms and counts in NVS too
+static void apiPostStats() {
+  if (!readJsonBody() || !g_reqDoc["reset"].as<bool>()) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  LOG_INFO("API", "POST /api/stats | reset");
+  statsClear();
+  statsCommit();
+  StaticJsonDocument<64> d;
+  d["message"] = "Stats cleared";
+  sendJsonOkObject(d);
+}
+
+// GET /api/trace: the recorder state and the stored order traces.
+// GET /api/trace?order=<id>: that order's trace file (format in Trace.cpp),
+// streamed from LittleFS. The running order's file grows block by block.
+static void apiGetTrace() {
+  String arg = httpArg("order");
+  if (arg.length()) {
+    uint16_t id = 0;
+    char path[24];
+    if (!traceFileId((arg + ".bin").c_str(), id) || !traceFsOk()) {
+      sendJsonError("NOT_FOUND");
+      return;
+    }
+    tracePath(path, sizeof(path), id);
+    if (!LittleFS.exists(path)) {
+      sendJsonError("NOT_FOUND");
+      return;
+    }
+    httpSendHeader("Content-Disposition", String("attachment; filename=\"trace-") + id + ".bin\"");
+    if (!httpSendFile(path, "application/octet-stream", false)) sendJsonError("NOT_FOUND");
+    return;
+  }
+
+  StaticJsonDocument<768> d;
+  d["sampleMs"] = TRACE_SAMPLE_MS;
+  d["samples"] = g_traceSamples;
+  d["ramBytes"] = sizeof(g_traceRam);
+  if (g_traceOrder) d["recording"] = g_traceOrder;
+  else d["recording"] = nullptr;
+  JsonArray orders = d.createNestedArray("orders");
+  File dir = traceFsOk() ? LittleFS.open(TRACE_DIR) : File();
+  if (dir && dir.isDirectory()) {
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+      uint16_t id;
+      if (!traceFileId(f.name(), id)) continue;
+      JsonObject o = orders.createNestedObject();
+      o["id"] = id;
+      o["bytes"] = f.size();
+    }
+  }
+  sendJsonOkObject(d);
+}
+
+static void apiGetLogs() {
+  uint32_t since = (uint32_t)strtoul(httpArg("since").c_str(), nullptr, 10);
+  uint32_t head = logHeadSeq();
+  uint32_t oldest = logOldestSeq();
+  if (since > head) since = 0; // client saw a previous boot: start over
+  uint32_t seq = since + 1;
+  uint32_t dropped = 0;
+  if (seq < oldest) {
+    dropped = oldest - seq;
+    seq = oldest;
+  }
+
+  static const size_t TAIL_RESERVE = 96; // room for the closing fields
+  const size_t cap = sizeof(g_logsOut) - TAIL_RESERVE;
+  size_t n = snprintf(g_logsOut, cap, "{\"ok\":true,\"data\":{\"head\":%lu,\"entries\":[", (unsigned long)head);
+
+  LogEntry e;
+  bool first = true;
+  for (; seq <= head; seq++) {
+    if (!logRead(seq, e)) { dropped++; continue; }
+    size_t mark = n;
+    int w = snprintf(g_logsOut + n, cap - n, "%s{\"seq\":%lu,\"ms\":%lu,\"level\":\"%s\",\"module\":\"%s\",\"msg\":\"",
+                     first ? "" : ",", (unsigned long)e.seq, (unsigned long)e.ms,
+                     LOG_LEVEL_NAMES[e.level], e.module);
+    bool fits = w > 0 && n + w < cap;
+    if (fits) {
+      n += w;
+      fits = jsonEscapeAppend(g_logsOut, cap, n, e.msg) && n + 2 < cap;
+    }
+    if (!fits) { n = mark; break; } // client continues from "next"
+    g_logsOut[n++] = '"';
+    g_logsOut[n++] = '}';
+    first = false;
+  }
+
+  n += snprintf(g_logsOut + n, sizeof(g_logsOut) - n, "],\"next\":%lu,\"dropped\":%lu},\"error\":null}",
+                (unsigned long)(seq - 1), (unsigned long)dropped);
+  httpSendBuf(200, "application/json", g_logsOut, n);
+}
+
+// POST /api/logs {"module":"FSM"|"*","level":"ERROR|WARN|INFO|DEBUG"}
+// "*" sets every module. DEBUG only has an effect in builds with
+// LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG.
+static void apiPostLogs() {
+  if (!readJsonBody()) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  JsonDocument& doc = g_reqDoc;
+
+  const char* module = doc["module"].as<const char*>();
+  if (!module) module = "*";
+  int level = parseEnumName(doc["level"].as<const char*>(), LOG_LEVEL_NAMES, LOG_LEVEL_DEBUG + 1, -1);
+  if (level < 0) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+
+  // logSetLevel() keeps the pointer, so pass the table's literal
+  const char* name = strcmp(module, "*") == 0 ? "*" : nullptr;
+  for (int i = 0; !name && i < LOG_MODULE_COUNT; i++) {
+    if (strcmp(module, LOG_MODULE_NAMES[i]) == 0) name = LOG_MODULE_NAMES[i];
+  }
+  if (!name || !logSetLevel(name, (uint8_t)level)) {
+    sendJsonError("BAD_PARAMS");
+    return;
+  }
+  LOG_INFOF("API", "POST /api/logs | module=%s level=%s", module, LOG_LEVEL_NAMES[level]);
+
+  StaticJsonDocument<256> d;
+  for (int i = 0; i < LOG_MODULE_COUNT; i++) d[LOG_MODULE_NAMES[i]] = LOG_LEVEL_NAMES[logLevel(LOG_MODULE_NAMES[i])];
+  sendJsonOkObject(d);
+}
+
+
+void setupRoutes() {
+  // API
+  httpOn("/api/status", HTTP_GET, apiStatus);
+  httpOn("/api/status.bin", HTTP_GET, apiStatusBin);
+  httpOn("/api/start", HTTP_POST, apiStart);
+  httpOn("/api/stop", HTTP_POST, apiStop);
+  httpOn("/api/settings", HTTP_GET, apiGetSettings);
+  httpOn("/api/settings", HTTP_POST, apiPostSettings);
+  httpOn("/api/audio", HTTP_POST, apiAudio);
+  httpOn("/api/heater/autotune", HTTP_POST, apiAutotune);
+  httpOn("/api/queue", HTTP_GET, apiGetQueue);
+  httpOn("/api/queue", HTTP_POST, apiPostQueue);
+  httpOn("/api/recipes", HTTP_GET, apiGetRecipes);
+  httpOn("/api/recipes", HTTP_POST, apiPostRecipes);
+  httpOn("/api/diag", HTTP_GET, apiDiag);
+  httpOn("/api/consumables", HTTP_GET, apiGetConsumables);
+  httpOn("/api/consumables", HTTP_POST, apiPostConsumables);
+  httpOn("/api/stats", HTTP_GET, apiGetStats);
+  httpOn("/api/stats", HTTP_POST, apiPostStats);
+  httpOn("/api/trace", HTTP_GET, apiGetTrace);
+  httpOn("/api/logs", HTTP_GET, apiGetLogs);
+  httpOn("/api/logs", HTTP_POST, apiPostLogs);
+
+#if USE_ASYNC_HTTP
+  events.onConnect([](AsyncEventSourceClient* c) {
+    CoreLock lock;
+    char json[SSE_JSON_MAX];
+    sseBuildStatusJson(json, sizeof(json));
+    c->send(json, "status", millis(), 3000);
+    LOG_INFO("API", String("GET /api/events | clients=") + sseClientCount());
+  });
+  server.addHandler(&events);
+#else
+  httpOn("/api/events", HTTP_GET, apiEvents);
+
+  // WebServer only keeps request headers it was told about
+  static const char* COLLECT_HEADERS[] = {"If-None-Match"};
+  server.collectHeaders(COLLECT_HEADERS, 1);
+#endif
+
+  // Captive portal common endpoints
+  httpOn("/", HTTP_GET, handleRoot);
+  httpOn("/generate_204", HTTP_GET, [](){ redirectToRoot(); }); // Android
+  httpOn("/fwlink", HTTP_GET, [](){ redirectToRoot(); });       // Windows
+  httpOn("/hotspot-detect.html", HTTP_GET, [](){ redirectToRoot(); }); // iOS
+  httpOn("/library/test/success.html", HTTP_GET, [](){ redirectToRoot(); }); // iOS
+
+  httpOnNotFound([]() {
+    String uri = httpUri();
+
+    // Serve static files if present
+    if (!isApiPath(uri)) {
+      if (tryServeFromLittleFS(uri)) return;
+      redirectToRoot();
+      return;
+    }
+
+    // API not found
+    StaticJsonDocument<128> d;
+    d["path"] = uri;
+    sendJsonEnvelope(404, false, &d, "NOT_FOUND");
+  });
+}
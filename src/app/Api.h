@@ -0,0 +1,16 @@
+#ifndef API_H
+#define API_H
+
+// REST handlers under /api, the diag/perf report and the route table.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+void setupRoutes(); // setup(), before server.begin()
+void fillStatusJson(JsonDocument& d); // /api/status data, also pushed by SSE and MQTT
+// Also run by MQTT commands through the HTTP shim (Http.h)
+void apiStart();
+void apiStop();
+void perfDumpIfDue(uint32_t now); // loop(), every PERF_DUMP_MS
+
+#endif
@@ -0,0 +1,155 @@
+#include "App.h"
+#include "../core/Logger.h"
+#include "Api.h"
+#include "AppConfig.h"
+#include "Audio.h"
+#include "CaptiveDns.h"
+#include "Consumables.h"
+#include "Http.h"
+#include "Machine.h"
+#include "Mqtt.h"
+#include "OrderStats.h"
+#include "Perf.h"
+#include "StatusPush.h"
+#include "Storage.h"
+#include "Trace.h"
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <esp_timer.h>
+
+
+static void startWiFiAndPortal() {
+  WiFi.mode(STA_SSID[0] ? WIFI_AP_STA : WIFI_AP);
+  WiFi.softAPConfig(AP_IP, AP_GW, AP_MASK);
+  WiFi.softAP(AP_SSID, AP_PASS, AP_CHANNEL);
+
+  IPAddress ip = WiFi.softAPIP();
+  LOG_INFO("NET", String("AP started | SSID=") + AP_SSID + " IP=" + ip.toString());
+
+  if (STA_SSID[0]) { // joins in the background, reconnects on its own
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(STA_SSID, STA_PASS);
+    LOG_INFO("NET", String("Uplink joining | SSID=") + STA_SSID);
+  }
+
+  dnsBegin(ip);
+}
+
+static bool g_bootLogged = false;
+
+// Finishes the boot stages that run after setup(); from loop() under CoreLock
+static void bootPoll() {
+  if (g_bootLogged) return;
+  if (!g_boot[BOOT_RECIPES].done && !fsPending()) {
+    bootBegin(BOOT_RECIPES);
+    if (fsReady()) g_machine.loadRecipes(LittleFS); // else built-ins only
+    bootEnd(BOOT_RECIPES);
+  }
+  if (!bootAllDone()) return;
+
+  g_bootLogged = true;
+  char line[160];
+  size_t used = 0;
+  for (uint8_t i = 0; i < BOOT_STAGE_COUNT && used < sizeof(line); i++) {
+    int w = snprintf(line + used, sizeof(line) - used, "%s%s=%lu", i ? " " : "", BOOT_STAGE_NAMES[i],
+                     (unsigned long)(g_boot[i].durUs / 1000));
+    if (w > 0) used += w;
+  }
+  LOG_INFOF("BOOT", "Boot breakdown (ms) | ready=%lu %s", (unsigned long)(g_bootReadyUs / 1000), line);
+}
+
+// Portal first: relays safe, then the cheap state the API needs (settings,
+// sensors), then Wi-Fi/DNS/HTTP. LittleFS mounts in fsBootTask meanwhile and
+// the DFPlayer is detected from loop() by its reply frame (bootPoll).
+void appSetup() {
+  bootBegin(BOOT_LOG);
+  Serial.begin(115200);
+  logBegin();
+  g_coreMutex = xSemaphoreCreateMutex();
+  bootEnd(BOOT_LOG);
+
+  LOG_INFO("BOOT", "ESP32 Coffee Machine | Plan v2.1 Patch (Revised) | src/app");
+  LOG_WARN("BOOT", "If boot issues happen: check strap pins GPIO12/4/15/2 + relay inputs. Use series resistors and avoid strong pulls.");
+
+  bootBegin(BOOT_PINS);
+  g_hal.begin(); // relays off before their outputs enable, then sensors
+  bootEnd(BOOT_PINS);
+
+  fsStartMount();
+
+  bootBegin(BOOT_SETTINGS);
+  g_settings.begin();
+  prefs.begin(SETTINGS_NS, false); // stays open: consumables and stats commits
+  consumablesLoad();
+  statsLoad();
+  bootEnd(BOOT_SETTINGS);
+
+  bootBegin(BOOT_SENSORS);
+  g_sensors.begin();
+  bootEnd(BOOT_SENSORS);
+
+  // DFPlayer (optional): its task waits for the module, then sends the volume
+  bootBegin(BOOT_DFPLAYER);
+  dfBegin();
+  audioApplyFromSettings();
+
+  // Start AP + captive portal + server
+  bootBegin(BOOT_WIFI);
+  startWiFiAndPortal();
+  bootEnd(BOOT_WIFI);
+
+  bootBegin(BOOT_HTTP);
+  setupRoutes();
+  machineBegin();
+  server.begin();
+  bootEnd(BOOT_HTTP);
+  g_bootReadyUs = (uint32_t)esp_timer_get_time();
+  LOG_INFO("NET", String("HTTP server started | backend=") + (USE_ASYNC_HTTP ? "async" : "sync"));
+  mqttBegin();
+
+  LOG_INFOF("BOOT", "System ready | %lums after reset", (unsigned long)(g_bootReadyUs / 1000));
+}
+
+void appLoop() {
+  uint32_t loopT0 = perfStart();
+#if !USE_ASYNC_HTTP
+  uint32_t t0 = perfStart();
+  server.handleClient();
+  perfEnd(PERF_HTTP, t0);
+#endif
+
+  {
+    CoreLock lock;
+
+    // FSM pass, if a deadline or a watched sensor event is due
+    fsmPass();
+
+    // Deferred NVS commits: settings, consumables, order stats
+    g_settings.flushIfDue(millis());
+    consumablesFlushIfDue(millis(), g_machine.isBusy());
+    statsFlushIfDue(millis(), g_machine.isBusy());
+
+    // DFPlayer detection, recipes once LittleFS is up
+    bootPoll();
+
+    // Deferred heavy-load relays (RELAY_SOFT_START_MS)
+    g_hal.softStartPump(millis());
+
+    // Telemetry sample, order trace files
+    traceUpdate(millis());
+
+    // Push status changes to /api/events subscribers
+    ssePump();
+
+    // MQTT uplink: order records, status, queued commands
+    mqttPump(millis());
+
+    // Periodic PERF summary on the serial log
+    perfDumpIfDue(millis());
+  }
+  perfEnd(PERF_LOOP, loopT0); // work only, not the sleep below
+
+  // Sleep until the next FSM deadline/event; DNS/HTTP polling caps it
+  fsmSleep(LOOP_POLL_MS);
+}
+
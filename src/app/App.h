@@ -0,0 +1,9 @@
+#ifndef APP_H
+#define APP_H
+
+// Firmware bring-up and main loop; CoffeeMachine.ino only forwards to these.
+
+void appSetup();
+void appLoop();
+
+#endif
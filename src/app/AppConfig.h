@@ -0,0 +1,92 @@
+#ifndef APP_CONFIG_H
+#define APP_CONFIG_H
+
+// Firmware settings around the shared core: HTTP backend, prompts, relay
+// power and soft start, pins, network. Included by every src/app module.
+
+#include "../core/Config.h"
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// HTTP backend: 0 = sync WebServer served from loop(),
+//               1 = ESPAsyncWebServer served from the AsyncTCP task
+#ifndef USE_ASYNC_HTTP
+#define USE_ASYNC_HTTP 0
+#endif
+
+// ---------- User config toggles ----------
+
+// Board pinout and relay polarity: COFFEE_BOARD in src/core/Board.h. Cup
+// threshold, cup filter (median + hysteresis, fast pings in VALIDATE and
+// while a pump runs) and sensor sample rates: src/core/CoreConfig.h. Timing,
+// PID, queue, idle power (Machine.cpp), AP and log ring: src/core/Config.h.
+
+// DFPlayer prompts played on state changes: SD card /MP3/0001.mp3 .. numbers,
+// 0 = silent. Skipped while muted.
+static const uint16_t AUDIO_TRACK_START = 1; // order started
+static const uint16_t AUDIO_TRACK_DONE  = 2; // drink ready
+static const uint16_t AUDIO_TRACK_ERROR = 3; // aborted with an error
+
+// Hot-path timing summary printed under PERF every PERF_DUMP_MS (0 = only on
+// /api/diag)
+static const uint32_t PERF_DUMP_MS = 300000;
+
+// /api/status log rate limit
+static const uint32_t STATUS_LOG_MIN_MS = 1000;
+
+// Nominal draw per relay (W), relay index order, for the energy counter. The
+// values are the phase power budget ones (POWER_W_* in src/core/Config.h).
+static const uint16_t RELAY_POWER_W[10] = {
+  POWER_W_TANK, POWER_W_TANK, POWER_W_TANK, // tank augers (sugar, coffee, Nescafe)
+  POWER_W_PUMP, POWER_W_PUMP,               // water pump, milk pump
+  POWER_W_HEATER_INTERNAL,                  // internal heater (thermoblock)
+  POWER_W_HEATER_EXTERNAL,                  // external heater (cup warmer)
+  POWER_W_MIXER, POWER_W_MIXER, POWER_W_MIXER // mixer rotate, up, down
+};
+
+// Soft start (Machine.cpp): a heavy load switched on less than RELAY_SOFT_START_MS
+// after another one waits for the gap, so pump/heater/motor inrush does not
+// stack. The delay comes off that step's on-time. 0 = off.
+static const uint32_t RELAY_SOFT_START_MS = 0;
+static const uint16_t RELAY_SOFT_START_MASK = 0x00F8; // pumps, heaters, mixer rotate
+
+// ---------- Pin map (no MCP23017) ----------
+
+// From src/core/Board.h (COFFEE_BOARD; default = the README pinout)
+
+// Relays (10)
+static const int PIN_RELAY_0  = BOARD_RELAY_TANK1_SUGAR;
+static const int PIN_RELAY_1  = BOARD_RELAY_TANK2_COFFEE;
+static const int PIN_RELAY_2  = BOARD_RELAY_TANK3_NESCAFE;
+static const int PIN_RELAY_3  = BOARD_RELAY_PUMP_WATER;
+static const int PIN_RELAY_4  = BOARD_RELAY_PUMP_MILK;
+static const int PIN_RELAY_5  = BOARD_RELAY_HEATER_INTERNAL; // Thermoblock
+static const int PIN_RELAY_6  = BOARD_RELAY_HEATER_EXTERNAL;
+static const int PIN_RELAY_7  = BOARD_RELAY_MIXER_ROTATE;
+static const int PIN_RELAY_8  = BOARD_RELAY_MIXER_UP;
+static const int PIN_RELAY_9  = BOARD_RELAY_MIXER_DOWN;
+
+// MAX6675, ultrasonic and limit switches: set up by Esp32Hal (src/core)
+
+// DFPlayer (UART2)
+static const int PIN_DF_TX2 = BOARD_DF_TX; // ESP32 TX2 -> DFPlayer RX (series 1k)
+static const int PIN_DF_RX2 = BOARD_DF_RX; // ESP32 RX2 <- DFPlayer TX
+
+// ---------- Network / portal ----------
+
+// AP_SSID / AP_PASS / AP_CHANNEL: src/core/Config.h
+static const IPAddress AP_IP(192, 168, 4, 1);
+static const IPAddress AP_GW(192, 168, 4, 1);
+static const IPAddress AP_MASK(255, 255, 255, 0);
+
+// Optional uplink (Mqtt.cpp). With STA_SSID set the AP stays up and the
+// machine also joins the site network (AP+STA: the AP moves to the site AP's
+// channel), publishes to MQTT_URI and takes orders over MQTT. "" = AP only.
+static const char* const STA_SSID = "";
+static const char* const STA_PASS = "";
+static const char* const MQTT_URI = "mqtt://192.168.1.2:1883";
+static const char* const MQTT_USER = "";             // "" = anonymous
+static const char* const MQTT_PASS = "";
+static const char* const MQTT_TOPIC_ROOT = "coffee"; // topics: <root>/<id>/...
+
+#endif
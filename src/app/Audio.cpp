@@ -0,0 +1,201 @@
+#include "Audio.h"
+#include "../core/Logger.h"
+#include "AppConfig.h"
+#include "Machine.h"
+#include "Perf.h"
+
+// Callers never touch the UART. dfEnqueue() posts to a small queue (dropped
+// when full, never waits) and df_setVolume_0_30() overwrites a single pending
+// volume, so a slider drag only sends its last value. dfTaskMain first waits
+// for the module's first reply frame (0x3F "online" after power-up, or the
+// answer to a status query when it was already up), then sends one frame at
+// a time with the feedback flag set, waits for its ACK (0x41) or error (0x40),
+// retries DF_RETRIES times and keeps DF_CMD_GAP_MS between frames. A module
+// that never answered (RX not wired) is driven blind, as before.
+// Frame: 7E FF 06 cmd feedback hi lo chk chk EF.
+static HardwareSerial& DFSerial = Serial2;
+
+// One command frame for the task's TX queue
+struct DfCommand {
+  uint8_t cmd;
+  uint16_t param;
+};
+
+static const uint8_t DF_QUEUE_LEN = 8;
+static const uint32_t DF_ACK_TIMEOUT_MS = 200;
+static const uint8_t DF_RETRIES = 2;
+static const uint32_t DF_CMD_GAP_MS = 50;
+static const uint32_t DF_QUERY_EVERY_MS = 250;
+static const uint32_t DF_READY_TIMEOUT_MS = 3000;
+static const uint32_t DF_TASK_STACK = 3072;
+static const UBaseType_t DF_TASK_PRIO = 1;
+static const BaseType_t DF_TASK_CORE = 0;
+
+QueueHandle_t g_dfQueue = nullptr;
+TaskHandle_t g_dfTask = nullptr;
+static std::atomic<int16_t> g_dfPendingVol(-1); // -1 = none
+std::atomic<bool> g_dfReady(false);
+bool g_dfAcks = false;
+std::atomic<uint32_t> g_dfDropped(0);
+std::atomic<uint32_t> g_dfFailed(0);
+
+// RX reassembly, audio task only
+static uint8_t g_dfRx[10];
+static uint8_t g_dfRxLen = 0;
+
+static uint16_t df_checksum(uint8_t *cmd) {
+  uint16_t sum = 0;
+  for (int i = 1; i < 7; i++) sum += cmd[i];
+  return 0 - sum;
+}
+
+static void df_send(uint8_t cmd, uint16_t param, bool feedback) {
+  uint8_t pkt[10] = {0x7E, 0xFF, 0x06, cmd, (uint8_t)(feedback ? 0x01 : 0x00),
+                     (uint8_t)(param >> 8), (uint8_t)(param & 0xFF),
+                     0x00, 0x00, 0xEF};
+  uint16_t chk = df_checksum(pkt);
+  pkt[7] = (uint8_t)(chk >> 8);
+  pkt[8] = (uint8_t)(chk & 0xFF);
+  DFSerial.write(pkt, 10);
+}
+
+// Drains RX; true with cmd/param for each complete frame with a good checksum
+static bool df_readFrame(uint8_t& cmd, uint16_t& param) {
+  while (DFSerial.available() > 0) {
+    uint8_t b = (uint8_t)DFSerial.read();
+    if (g_dfRxLen == 0 && b != 0x7E) continue; // resync on start byte
+    g_dfRx[g_dfRxLen++] = b;
+    if (g_dfRxLen < sizeof(g_dfRx)) continue;
+    g_dfRxLen = 0;
+
+    uint16_t chk = ((uint16_t)g_dfRx[7] << 8) | g_dfRx[8];
+    if (g_dfRx[9] != 0xEF || chk != df_checksum(g_dfRx)) continue;
+    cmd = g_dfRx[3];
+    param = ((uint16_t)g_dfRx[5] << 8) | g_dfRx[6];
+    return true;
+  }
+  return false;
+}
+
+// Frames the module sends on its own (track finished, card in/out, ...)
+static void df_onEvent(uint8_t cmd, uint16_t param) {
+  (void)cmd; // unused when LOGDF compiles out
+  (void)param;
+  LOG_DEBUGF("AUDIO", "DFPlayer event | cmd=0x%02X param=%u", cmd, param);
+}
+
+// One command: send, wait for the ACK, retry on error or timeout
+static bool df_transact(const DfCommand& c) {
+  if (!g_dfAcks) {
+    df_send(c.cmd, c.param, false);
+    return true;
+  }
+  for (uint8_t attempt = 0; attempt <= DF_RETRIES; attempt++) {
+    df_send(c.cmd, c.param, true);
+    uint32_t t0 = millis();
+    while (millis() - t0 < DF_ACK_TIMEOUT_MS) {
+      uint8_t cmd;
+      uint16_t param;
+      if (!df_readFrame(cmd, param)) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+        continue;
+      }
+      if (cmd == 0x41) return true;
+      if (cmd == 0x40) {
+        LOG_WARNF("AUDIO", "DFPlayer error | cmd=0x%02X code=%u try=%u", c.cmd, param, attempt + 1);
+        break;
+      }
+      df_onEvent(cmd, param);
+    }
+    vTaskDelay(pdMS_TO_TICKS(DF_CMD_GAP_MS));
+  }
+  return false;
+}
+
+static void dfTaskMain(void*) {
+  uint8_t cmd;
+  uint16_t param;
+  uint32_t t0 = millis();
+  uint32_t lastQuery = 0;
+  bool answered = false;
+  while (!answered && millis() - t0 < DF_READY_TIMEOUT_MS) {
+    if (millis() - lastQuery >= DF_QUERY_EVERY_MS) {
+      lastQuery = millis();
+      df_send(0x42, 0, false); // query status
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+    while (df_readFrame(cmd, param)) answered = true;
+  }
+  bootEnd(BOOT_DFPLAYER);
+  g_dfAcks = answered;
+  if (answered) LOG_INFOF("AUDIO", "DFPlayer ready | after=%lums", (unsigned long)(millis() - t0));
+  else LOG_WARN("AUDIO", "DFPlayer did not answer (check TX wiring); sending blind");
+  g_dfReady.store(true);
+
+  for (;;) {
+    DfCommand c;
+    int16_t vol = g_dfPendingVol.exchange(-1);
+    if (vol >= 0) {
+      c.cmd = 0x06;
+      c.param = (uint16_t)vol;
+    } else if (xQueueReceive(g_dfQueue, &c, 0) != pdTRUE) {
+      while (df_readFrame(cmd, param)) df_onEvent(cmd, param);
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+      continue;
+    }
+
+    if (!df_transact(c)) {
+      g_dfFailed.fetch_add(1);
+      LOG_WARNF("AUDIO", "DFPlayer command dropped | cmd=0x%02X param=%u after %u tries",
+            c.cmd, c.param, DF_RETRIES + 1);
+    }
+    vTaskDelay(pdMS_TO_TICKS(DF_CMD_GAP_MS));
+  }
+}
+
+void dfBegin() {
+  DFSerial.begin(9600, SERIAL_8N1, PIN_DF_RX2, PIN_DF_TX2);
+  g_dfQueue = xQueueCreate(DF_QUEUE_LEN, sizeof(DfCommand));
+  if (!g_dfQueue ||
+      xTaskCreatePinnedToCore(dfTaskMain, "dfplayer", DF_TASK_STACK, nullptr,
+                              DF_TASK_PRIO, &g_dfTask, DF_TASK_CORE) != pdPASS) {
+    LOG_ERROR("BOOT", "DFPlayer task create failed (audio disabled)");
+    bootEnd(BOOT_DFPLAYER);
+  }
+}
+
+// Never blocks; false if the queue is full (or audio is disabled)
+static bool dfEnqueue(uint8_t cmd, uint16_t param) {
+  if (!g_dfQueue) return false;
+  DfCommand c;
+  c.cmd = cmd;
+  c.param = param;
+  if (xQueueSend(g_dfQueue, &c, 0) != pdTRUE) {
+    g_dfDropped.fetch_add(1);
+    return false;
+  }
+  if (g_dfTask) xTaskNotifyGive(g_dfTask);
+  return true;
+}
+
+static void df_setVolume_0_30(uint8_t vol) {
+  if (vol > 30) vol = 30;
+  g_dfPendingVol.store(vol); // replaces any unsent volume
+  if (g_dfTask) xTaskNotifyGive(g_dfTask);
+}
+
+void audioApplyFromSettings() {
+  // Map 0..100 => 0..30
+  uint8_t vol30 = (uint8_t)roundf((g_settings.get().audioVolume / 100.0f) * 30.0f);
+  if (g_settings.get().audioMuted) vol30 = 0;
+
+  df_setVolume_0_30(vol30);
+  LOG_INFO("AUDIO", String("Apply audio | muted=") + (g_settings.get().audioMuted ? "true" : "false") +
+                  " volume=" + g_settings.get().audioVolume + "% -> " + vol30 + "/30");
+}
+
+void audioPrompt(uint16_t track) {
+  if (track == 0 || g_settings.get().audioMuted) return;
+  // 0x12 = play /MP3/<track>
+  if (!dfEnqueue(0x12, track)) LOG_WARNF("AUDIO", "Prompt %u dropped (queue full)", track);
+}
@@ -0,0 +1,21 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+// DFPlayer Mini on Serial2, driven by its own task: prompts and volume.
+
+#include <Arduino.h>
+#include <atomic>
+
+void dfBegin(); // starts the audio task; it waits for the module itself
+void audioApplyFromSettings(); // queues the volume from g_settings
+void audioPrompt(uint16_t track); // /MP3/<track>; 0 or muted = silent, never waits
+
+// For /api/diag
+extern QueueHandle_t g_dfQueue;
+extern TaskHandle_t g_dfTask;
+extern std::atomic<bool> g_dfReady;      // boot wait over
+extern bool g_dfAcks;                    // module answered: wait for ACKs
+extern std::atomic<uint32_t> g_dfDropped; // queue full
+extern std::atomic<uint32_t> g_dfFailed;  // no ACK after retries
+
+#endif
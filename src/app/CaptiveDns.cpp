@@ -0,0 +1,164 @@
+#include "CaptiveDns.h"
+#include "../core/Logger.h"
+#include "Perf.h"
+#include <lwip/sockets.h>
+
+// Every name resolves to the AP, as DNSServer's "*" did, but off loop(): a
+// task on the network core blocks in recvfrom() on UDP/53 and answers in
+// place. An A/IN query gets its question echoed plus a pre-built answer
+// (pointer to the question name, TTL, AP address); every other type, AAAA
+// included, an immediate NXDOMAIN, as DNSServer replied. Options (EDNS) and
+// any other section after the question are dropped. Each client gets
+// DNS_RATE_PER_S queries with a DNS_BURST reserve; the rest, and anything
+// malformed, is dropped without an answer (phones retry). The socket is bound
+// to the AP address, so with the uplink up (AP+STA) queries that reach the
+// station interface are never answered with the portal address.
+
+// Rate limit, one per recent AP client
+struct DnsClient {
+  uint32_t ip;     // network order, 0 = free slot
+  uint32_t seenMs; // last query
+  uint32_t credit; // DNS_CREDIT_PER_QUERY per allowed query
+};
+
+static const uint16_t DNS_PORT = 53;
+static const uint32_t DNS_TTL_S = 60;
+static const uint8_t DNS_CLIENTS = 8;
+static const uint32_t DNS_RATE_PER_S = 10;
+static const uint32_t DNS_BURST = 20;
+static const uint32_t DNS_CREDIT_PER_QUERY = 1000; // credit refills DNS_RATE_PER_S per ms
+static const size_t DNS_PACKET_MAX = 512;          // plain UDP DNS
+static const uint32_t DNS_TASK_STACK = 3072;
+static const UBaseType_t DNS_TASK_PRIO = 1;
+static const BaseType_t DNS_TASK_CORE = 0;         // with the Wi-Fi/lwIP tasks
+static const uint32_t DNS_ERROR_BACKOFF_MS = 500;  // recvfrom() failed: reopen after
+
+TaskHandle_t g_dnsTask = nullptr;
+static uint8_t g_dnsAnswerA[16];          // built once by dnsBegin()
+static uint32_t g_dnsBindAddr = 0;        // AP address, network order; set by dnsBegin()
+static DnsClient g_dnsClients[DNS_CLIENTS]; // DNS task only
+std::atomic<uint32_t> g_dnsAnswered(0);
+std::atomic<uint32_t> g_dnsNxdomain(0);
+std::atomic<uint32_t> g_dnsLimited(0);
+std::atomic<uint32_t> g_dnsMalformed(0);
+std::atomic<uint32_t> g_dnsErrors(0);
+
+static bool dnsAllow(uint32_t ip, uint32_t now) {
+  DnsClient* c = nullptr;
+  DnsClient* victim = &g_dnsClients[0];
+  for (uint8_t i = 0; i < DNS_CLIENTS && !c; i++) {
+    DnsClient& e = g_dnsClients[i];
+    if (e.ip == ip) c = &e;
+    else if (e.ip == 0 || (victim->ip != 0 && now - e.seenMs > now - victim->seenMs)) victim = &e;
+  }
+  if (!c) {
+    c = victim; // free slot, else the longest quiet client
+    c->ip = ip;
+    c->credit = DNS_BURST * DNS_CREDIT_PER_QUERY;
+  } else {
+    uint32_t full = DNS_BURST * DNS_CREDIT_PER_QUERY, quietMs = now - c->seenMs;
+    c->credit = quietMs >= full / DNS_RATE_PER_S ? full : min(c->credit + quietMs * DNS_RATE_PER_S, full);
+  }
+  c->seenMs = now;
+  if (c->credit < DNS_CREDIT_PER_QUERY) return false;
+  c->credit -= DNS_CREDIT_PER_QUERY;
+  return true;
+}
+
+// Turns the query in buf into its answer; returns the reply length, 0 = drop
+static size_t dnsReply(uint8_t* buf, size_t len) {
+  if (len < 12) return 0;
+  bool query = (buf[2] & 0x80) == 0, standard = (buf[2] & 0x78) == 0;
+  uint16_t qdcount = (uint16_t)(buf[4] << 8 | buf[5]);
+  if (!query || !standard || qdcount != 1) return 0;
+
+  size_t pos = 12; // QNAME: labels up to the root, no compression in a query
+  while (pos < len && buf[pos] != 0) {
+    if (buf[pos] > 63) return 0;
+    pos += 1 + buf[pos];
+  }
+  if (pos + 5 > len) return 0;
+  uint16_t qtype = (uint16_t)(buf[pos + 1] << 8 | buf[pos + 2]);
+  uint16_t qclass = (uint16_t)(buf[pos + 3] << 8 | buf[pos + 4]);
+  size_t end = pos + 5;
+  bool a = qtype == 1 && qclass == 1;
+
+  buf[2] = (uint8_t)(0x84 | (buf[2] & 0x01)); // QR, AA, RD echoed
+  buf[3] = a ? 0x80 : 0x83;                    // RA, NOERROR / NXDOMAIN
+  buf[6] = 0; buf[7] = a ? 1 : 0;              // ANCOUNT
+  buf[8] = buf[9] = buf[10] = buf[11] = 0;     // NSCOUNT, ARCOUNT
+  if (!a) return end;
+  memcpy(buf + end, g_dnsAnswerA, sizeof(g_dnsAnswerA));
+  return end + sizeof(g_dnsAnswerA);
+}
+
+// UDP/53 on the AP address; -1 on failure
+static int dnsOpen() {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(DNS_PORT);
+  local.sin_addr.s_addr = g_dnsBindAddr;
+  if (sock >= 0 && bind(sock, (sockaddr*)&local, sizeof(local)) == 0) return sock;
+  if (sock >= 0) close(sock);
+  return -1;
+}
+
+static void dnsTaskMain(void*) {
+  int sock = dnsOpen();
+  if (sock < 0) {
+    LOG_ERROR("NET", "DNS socket/bind failed, captive DNS off");
+    g_dnsTask = nullptr;
+    vTaskDelete(nullptr);
+    return;
+  }
+
+  // Room for the answer behind the longest accepted question
+  static uint8_t buf[DNS_PACKET_MAX + sizeof(g_dnsAnswerA)];
+  for (;;) {
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int n = recvfrom(sock, buf, DNS_PACKET_MAX, 0, (sockaddr*)&from, &fromLen);
+    if (n < 0) { // e.g. the AP netif went away: back off, then start over
+      g_dnsErrors.fetch_add(1);
+      close(sock);
+      do vTaskDelay(pdMS_TO_TICKS(DNS_ERROR_BACKOFF_MS));
+      while ((sock = dnsOpen()) < 0);
+      continue;
+    }
+    uint32_t t0 = perfStart();
+    if (!dnsAllow(from.sin_addr.s_addr, millis())) {
+      g_dnsLimited.fetch_add(1);
+      continue;
+    }
+    size_t out = dnsReply(buf, (size_t)n);
+    if (out == 0) {
+      g_dnsMalformed.fetch_add(1);
+      continue;
+    }
+    if (buf[3] == 0x80) g_dnsAnswered.fetch_add(1);
+    else g_dnsNxdomain.fetch_add(1);
+    sendto(sock, buf, out, 0, (sockaddr*)&from, fromLen);
+    perfEnd(PERF_DNS, t0);
+  }
+}
+
+void dnsBegin(IPAddress ip) {
+  static const uint8_t head[] = {0xC0, 0x0C, 0, 1, 0, 1}; // name -> question, A, IN
+  memcpy(g_dnsAnswerA, head, sizeof(head));
+  g_dnsAnswerA[6] = (uint8_t)(DNS_TTL_S >> 24);
+  g_dnsAnswerA[7] = (uint8_t)(DNS_TTL_S >> 16);
+  g_dnsAnswerA[8] = (uint8_t)(DNS_TTL_S >> 8);
+  g_dnsAnswerA[9] = (uint8_t)DNS_TTL_S;
+  g_dnsAnswerA[10] = 0;
+  g_dnsAnswerA[11] = 4;
+  for (int i = 0; i < 4; i++) g_dnsAnswerA[12 + i] = ip[i];
+  g_dnsBindAddr = htonl((uint32_t)ip[0] << 24 | (uint32_t)ip[1] << 16 | (uint32_t)ip[2] << 8 | ip[3]);
+
+  if (xTaskCreatePinnedToCore(dnsTaskMain, "dns", DNS_TASK_STACK, nullptr, DNS_TASK_PRIO,
+                              &g_dnsTask, DNS_TASK_CORE) != pdPASS) {
+    LOG_ERROR("NET", "DNS task create failed, captive DNS off");
+    return;
+  }
+  LOG_INFOF("NET", "DNS wildcard started | %u/s per client, burst %u", (unsigned)DNS_RATE_PER_S, (unsigned)DNS_BURST);
+}
@@ -0,0 +1,20 @@
+#ifndef CAPTIVE_DNS_H
+#define CAPTIVE_DNS_H
+
+// Captive-portal DNS on its own task: every A query answers the AP address.
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <atomic>
+
+void dnsBegin(IPAddress ip); // AP address; starts the task
+
+// For /api/diag
+extern TaskHandle_t g_dnsTask;
+extern std::atomic<uint32_t> g_dnsAnswered;
+extern std::atomic<uint32_t> g_dnsNxdomain;
+extern std::atomic<uint32_t> g_dnsLimited;
+extern std::atomic<uint32_t> g_dnsMalformed;
+extern std::atomic<uint32_t> g_dnsErrors;
+
+#endif
@@ -0,0 +1,147 @@
+#include "Consumables.h"
+#include "../core/Crc32.h"
+#include "../core/Logger.h"
+#include "Storage.h"
+#include <stddef.h>
+
+// Relay on-time of the five dispensing relays is counted as it is switched off
+// (Machine.cpp), so stopped and aborted orders count too. A calibration factor
+// (perSec, measured by running the relay into a cup on a scale) turns it into
+// grams or millilitres: remaining = fill - (runMs - refillRunMs) * perSec.
+// Counters live in their own "cons" blob, committed once the machine has been
+// idle CONS_COMMIT_IDLE_MS (about one write per order), at most
+// CONS_COMMIT_MAX_MS after the first uncommitted change. A power cut loses at
+// most the order in progress. Finished orders feed perOrder, which with the
+// order-gap EWMA (MachineController) gives the forecast on /api/consumables.
+static const char* const CONS_BLOB_KEY = "cons";
+static const uint16_t CONS_BLOB_VERSION = 1;
+static const float CONS_ORDER_ALPHA = 0.2f;
+
+struct ConsumablesBlob {
+  uint16_t version;  // CONS_BLOB_VERSION
+  uint16_t size;     // sizeof(c) when written
+  Consumable c[CONS_COUNT];
+  uint32_t orders;   // finished orders seen by perOrder
+  uint32_t crc;      // CRC-32 of the bytes before it
+};
+
+const char* const CONS_NAMES[CONS_COUNT] = {"sugar", "coffee", "nescafe", "water", "milk"};
+const char* const CONS_UNITS[CONS_COUNT] = {"g", "g", "g", "ml", "ml"};
+
+Consumable g_cons[CONS_COUNT];
+uint32_t g_consOrders = 0;
+static uint32_t g_consOrderRunMs[CONS_COUNT]; // runMs when the running order started
+static uint8_t g_consLowMask = 0;             // bit i = CONS_NAMES[i] at or below lowAt
+static uint32_t g_consDirtySinceMs = 0;       // 0 = clean
+static uint32_t g_consChangedMs = 0;
+
+// Rough figures for the stock hoppers and pumps; calibrate per machine
+static void consumablesDefaults() {
+  static const float PER_SEC[CONS_COUNT]  = {2.0f, 1.5f, 1.5f, 20.0f, 15.0f};
+  static const float CAPACITY[CONS_COUNT] = {1000.0f, 500.0f, 500.0f, 5000.0f, 2000.0f};
+  memset(g_cons, 0, sizeof(g_cons));
+  for (uint8_t i = 0; i < CONS_COUNT; i++) {
+    g_cons[i].perSec = PER_SEC[i];
+    g_cons[i].capacity = CAPACITY[i];
+    g_cons[i].lowAt = CAPACITY[i] * 0.15f;
+    g_cons[i].fill = CAPACITY[i];
+  }
+  g_consOrders = 0;
+}
+
+// extraMs: relay on right now
+float consumableRemaining(uint8_t i, uint32_t extraMs) {
+  const Consumable& c = g_cons[i];
+  return c.fill - (float)(c.runMs - c.refillRunMs + extraMs) * c.perSec / 1000.0f;
+}
+
+bool consumableLow(uint8_t i, uint32_t extraMs) {
+  return g_cons[i].perSec > 0 && consumableRemaining(i, extraMs) <= g_cons[i].lowAt;
+}
+
+void consumablesUpdateLow() {
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < CONS_COUNT; i++) {
+    if (consumableLow(i, 0)) mask |= (uint8_t)(1u << i);
+  }
+  uint8_t fresh = mask & (uint8_t)~g_consLowMask;
+  g_consLowMask = mask;
+  for (uint8_t i = 0; fresh; i++, fresh >>= 1) {
+    if (fresh & 1) LOG_WARNF("HW", "Low stock | %s %.0f%s left", CONS_NAMES[i], consumableRemaining(i, 0), CONS_UNITS[i]);
+  }
+}
+
+// Same framing and CRC as the settings blob; false keeps the defaults
+static bool consumablesReadBlob() {
+  ConsumablesBlob b;
+  if (!prefs.isKey(CONS_BLOB_KEY)) return false;
+  if (prefs.getBytesLength(CONS_BLOB_KEY) != sizeof(b) || prefs.getBytes(CONS_BLOB_KEY, &b, sizeof(b)) != sizeof(b)) {
+    LOG_ERROR("SETTINGS", "Consumables blob unreadable, using defaults");
+    return false;
+  }
+  if (b.version != CONS_BLOB_VERSION || b.size != sizeof(b.c) ||
+      crc32Update(0, (const uint8_t*)&b, offsetof(ConsumablesBlob, crc)) != b.crc) {
+    LOG_ERROR("SETTINGS", "Consumables blob invalid, using defaults");
+    return false;
+  }
+  memcpy(g_cons, b.c, sizeof(g_cons));
+  g_consOrders = b.orders;
+  return true;
+}
+
+void consumablesCommit() {
+  g_consDirtySinceMs = 0;
+  ConsumablesBlob b;
+  memset(&b, 0, sizeof(b));
+  b.version = CONS_BLOB_VERSION;
+  b.size = sizeof(b.c);
+  memcpy(b.c, g_cons, sizeof(b.c));
+  b.orders = g_consOrders;
+  b.crc = crc32Update(0, (const uint8_t*)&b, offsetof(ConsumablesBlob, crc));
+  if (prefs.putBytes(CONS_BLOB_KEY, &b, sizeof(b)) != sizeof(b)) {
+    LOG_ERROR("SETTINGS", "NVS write failed, consumables not persisted");
+    return;
+  }
+  LOG_DEBUG("SETTINGS", "Saved consumables to NVS");
+}
+
+void consumablesLoad() {
+  consumablesDefaults();
+  const char* from = consumablesReadBlob() ? "NVS blob" : "defaults";
+  consumablesUpdateLow();
+  LOG_INFOF("SETTINGS", "Loaded consumables from %s | low=0x%02x", from, g_consLowMask);
+}
+
+static void consumablesMarkDirty(uint32_t now) {
+  g_consChangedMs = now;
+  if (g_consDirtySinceMs == 0) g_consDirtySinceMs = now | 1;
+}
+
+void consumablesRun(int idx, uint32_t ms, uint32_t now) {
+  if (idx >= CONS_COUNT || ms == 0) return;
+  g_cons[idx].runMs += ms;
+  consumablesMarkDirty(now);
+}
+
+void consumablesOrderBegin() {
+  for (uint8_t i = 0; i < CONS_COUNT; i++) g_consOrderRunMs[i] = g_cons[i].runMs;
+}
+
+// Every relay is off, so runMs is complete
+void consumablesOrderDone(uint32_t now) {
+  for (uint8_t i = 0; i < CONS_COUNT; i++) {
+    float used = (float)(g_cons[i].runMs - g_consOrderRunMs[i]) * g_cons[i].perSec / 1000.0f;
+    if (g_consOrders == 0) g_cons[i].perOrder = used;
+    else g_cons[i].perOrder += CONS_ORDER_ALPHA * (used - g_cons[i].perOrder);
+  }
+  g_consOrders++;
+  consumablesUpdateLow();
+  consumablesMarkDirty(now);
+}
+
+void consumablesFlushIfDue(uint32_t now, bool busy) {
+  if (g_consDirtySinceMs == 0) return;
+  bool idleLongEnough = !busy && now - g_consChangedMs >= CONS_COMMIT_IDLE_MS;
+  if (!idleLongEnough && now - g_consDirtySinceMs < CONS_COMMIT_MAX_MS) return;
+  consumablesCommit();
+}
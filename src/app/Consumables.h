@@ -0,0 +1,41 @@
+#ifndef CONSUMABLES_H
+#define CONSUMABLES_H
+
+// Ingredient stock, one per dispensing relay; the id is the relay index.
+
+#include <Arduino.h>
+
+enum ConsumableId : uint8_t { CONS_SUGAR, CONS_COFFEE, CONS_NESCAFE, CONS_WATER, CONS_MILK, CONS_COUNT };
+
+struct Consumable {
+  float perSec;         // g (tanks) or ml (pumps) per second on; 0 = not tracked
+  float capacity;       // full hopper / container
+  float lowAt;          // low-stock level, same unit
+  float fill;           // amount in stock at the last refill
+  uint32_t runMs;       // relay on-time, lifetime
+  uint32_t refillRunMs; // runMs at the last refill
+  float perOrder;       // EWMA of the amount one finished order used
+};
+
+// Idle-commit rule of the NVS blobs (order stats use it too)
+static const uint32_t CONS_COMMIT_IDLE_MS = 5000;
+static const uint32_t CONS_COMMIT_MAX_MS = 10UL * 60UL * 1000UL;
+
+extern const char* const CONS_NAMES[CONS_COUNT];
+extern const char* const CONS_UNITS[CONS_COUNT];
+extern Consumable g_cons[CONS_COUNT];
+extern uint32_t g_consOrders; // finished orders seen by perOrder
+
+void consumablesLoad(); // After prefs.begin() in setup()
+void consumablesCommit();
+void consumablesFlushIfDue(uint32_t now, bool busy); // From loop(), under CoreLock
+void consumablesUpdateLow();
+float consumableRemaining(uint8_t i, uint32_t extraMs); // extraMs: on-time not yet counted
+bool consumableLow(uint8_t i, uint32_t extraMs);
+
+// Relay idx switched off after ms on (Machine.cpp)
+void consumablesRun(int idx, uint32_t ms, uint32_t now);
+void consumablesOrderBegin();
+void consumablesOrderDone(uint32_t now); // Pipeline done; every relay is off
+
+#endif
@@ -0,0 +1,369 @@
+#include "Http.h"
+#include "../core/Logger.h"
+#include "Machine.h"
+#include "Perf.h"
+#include "Storage.h"
+#include <LittleFS.h>
+
+#if USE_ASYNC_HTTP
+AsyncWebServer server(80);
+AsyncEventSource events("/api/events");
+#else
+WebServer server(80);
+#endif
+
+SemaphoreHandle_t g_coreMutex = nullptr;
+
+// LittleFS static asset, resolved once per path (see assetLookup)
+struct StaticAsset {
+  String path;              // request path, e.g. "/index.html"
+  String fsPath;            // file served, e.g. "/index.html.gz"; "" = not on LittleFS
+  const char* contentType;
+  bool gzip;
+  char etag[24];            // quoted strong ETag: "<fnv1a>-<size>"
+};
+
+// Handlers never touch `server` directly; they go through http*() so the same
+// code runs on either backend. On the async backend the request being served
+// is held in g_req for the duration of the handler (called under CoreLock).
+
+// MQTT commands (Mqtt.cpp) run the same handlers from loop(): while
+// g_cmdBody is set, httpParseBody() reads it and httpSendBuf() leaves the
+// reply in g_cmdReply for the caller to publish.
+const char* g_cmdBody = nullptr;
+const char* g_cmdReply = nullptr;
+size_t g_cmdReplyLen = 0;
+
+#if USE_ASYNC_HTTP
+static const size_t HTTP_MAX_BODY = 2048;
+static const int HTTP_MAX_HEADERS = 4;
+static AsyncWebServerRequest* g_req = nullptr;
+static String g_hdrName[HTTP_MAX_HEADERS];
+static String g_hdrValue[HTTP_MAX_HEADERS];
+static int g_hdrCount = 0;
+#endif
+
+void httpSendHeader(const String& name, const String& value) {
+#if USE_ASYNC_HTTP
+  if (g_hdrCount >= HTTP_MAX_HEADERS) return;
+  g_hdrName[g_hdrCount] = name;
+  g_hdrValue[g_hdrCount] = value;
+  g_hdrCount++;
+#else
+  server.sendHeader(name, value);
+#endif
+}
+
+static void httpSend(int code, const char* type, const String& body) {
+#if USE_ASYNC_HTTP
+  AsyncWebServerResponse* r = g_req->beginResponse(code, type, body);
+  for (int i = 0; i < g_hdrCount; i++) r->addHeader(g_hdrName[i], g_hdrValue[i]);
+  g_hdrCount = 0;
+  g_req->send(r);
+#else
+  server.send(code, type, body);
+#endif
+}
+
+String httpUri() {
+#if USE_ASYNC_HTTP
+  return g_req->url();
+#else
+  return server.uri();
+#endif
+}
+
+// Parses the request body into doc; false if there is none or it is not JSON.
+bool httpParseBody(JsonDocument& doc) {
+  if (g_cmdBody) return !deserializeJson(doc, g_cmdBody); // copies: body is const
+#if USE_ASYNC_HTTP
+  char* body = (char*)g_req->_tempObject;
+  if (!body) return false;
+  return !deserializeJson(doc, body); // zero-copy: strings stay in the body buffer
+#else
+  if (!server.hasArg("plain")) return false;
+  return !deserializeJson(doc, server.arg("plain"));
+#endif
+}
+
+// Sends len bytes of buf (text or binary) with Content-Length framing.
+// Sync: written straight to the socket. Async: the response outlives the
+// handler, so it is copied once into the response stream.
+void httpSendBuf(int code, const char* type, const char* buf, size_t len) {
+  if (g_cmdBody) {
+    g_cmdReply = buf; // g_jsonOut or a literal, valid until the next handler
+    g_cmdReplyLen = len;
+    return;
+  }
+#if USE_ASYNC_HTTP
+  AsyncResponseStream* r = g_req->beginResponseStream(type, len ? len : 1);
+  r->setCode(code);
+  r->write((const uint8_t*)buf, len);
+  for (int i = 0; i < g_hdrCount; i++) r->addHeader(g_hdrName[i], g_hdrValue[i]);
+  g_hdrCount = 0;
+  g_req->send(r);
+#else
+  server.send_P(code, type, buf, len);
+#endif
+}
+
+String httpHeader(const char* name) {
+#if USE_ASYNC_HTTP
+  AsyncWebServerRequest::P* h = g_req->getHeader(name);
+  return h ? h->value() : String();
+#else
+  return server.header(name);
+#endif
+}
+
+// Query-string argument; "" if absent.
+String httpArg(const char* name) {
+#if USE_ASYNC_HTTP
+  AsyncWebServerRequest::P* p = g_req->getParam(name);
+  return p ? p->value() : String();
+#else
+  return server.arg(name);
+#endif
+}
+
+// Streams a LittleFS file; pending httpSendHeader() headers are included.
+bool httpSendFile(const String& fsPath, const char* type, bool gzip) {
+#if USE_ASYNC_HTTP
+  AsyncWebServerResponse* r = g_req->beginResponse(LittleFS, fsPath, type);
+  if (!r) return false;
+  for (int i = 0; i < g_hdrCount; i++) r->addHeader(g_hdrName[i], g_hdrValue[i]);
+  g_hdrCount = 0;
+  if (gzip) r->addHeader("Content-Encoding", "gzip");
+  g_req->send(r); // streamed by AsyncTCP in chunks after the handler returns
+  return true;
+#else
+  File f = LittleFS.open(fsPath, "r");
+  if (!f) return false;
+  (void)gzip; // streamFile() adds Content-Encoding itself for *.gz names
+  server.streamFile(f, type);
+  f.close();
+  return true;
+#endif
+}
+
+#if USE_ASYNC_HTTP
+// Collects the request body into _tempObject (freed by the request destructor).
+static void asyncCollectBody(AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total) {
+  if (total > HTTP_MAX_BODY) return;
+  if (index == 0) req->_tempObject = malloc(total + 1);
+  char* buf = (char*)req->_tempObject;
+  if (!buf) return;
+  memcpy(buf + index, data, len);
+  if (index + len == total) buf[total] = 0;
+}
+
+static void asyncDispatch(AsyncWebServerRequest* req, HttpHandler h, uint8_t perfId) {
+  CoreLock lock;
+  g_req = req;
+  g_hdrCount = 0;
+  powerActivity();
+  uint32_t t0 = perfStart();
+  h();
+  perfEnd(perfId, t0);
+  g_req = nullptr;
+  fsmWake(); // the handler may have started, queued or stopped an order
+}
+#endif
+
+#if !USE_ASYNC_HTTP
+static void syncDispatch(HttpHandler h, uint8_t perfId) { // as asyncDispatch()
+  powerActivity();
+  uint32_t t0 = perfStart();
+  h();
+  perfEnd(perfId, t0);
+  fsmWake();
+}
+#endif
+
+void httpOn(const char* uri, HttpMethod method, HttpHandler h) {
+  uint8_t id = perfApiSlot(method == HTTP_POST ? "POST" : "GET", uri);
+#if USE_ASYNC_HTTP
+  server.on(uri, method, [h, id](AsyncWebServerRequest* req) { asyncDispatch(req, h, id); },
+            nullptr, asyncCollectBody);
+#else
+  server.on(uri, method, [h, id]() { syncDispatch(h, id); });
+#endif
+}
+
+void httpOnNotFound(HttpHandler h) {
+  uint8_t id = perfApiSlot("ANY", "(not found)");
+#if USE_ASYNC_HTTP
+  server.onNotFound([h, id](AsyncWebServerRequest* req) { asyncDispatch(req, h, id); });
+  server.onRequestBody(asyncCollectBody);
+#else
+  server.onNotFound([h, id]() { syncDispatch(h, id); });
+#endif
+}
+
+
+// JSON replies are framed by hand as {"ok":..,"data":..,"error":..} around one
+// serializeJson() of the payload straight into g_jsonOut: no wrapper document,
+// no String per request. Request bodies all parse into the one g_reqDoc arena.
+// Both are only touched from handlers (single-threaded under CoreLock).
+static char g_jsonOut[768];
+static size_t g_jsonOutLen = 0;
+static bool g_jsonOutOverflow = false;
+StaticJsonDocument<1024> g_reqDoc;
+
+static void jsonOutBegin() {
+  g_jsonOutLen = 0;
+  g_jsonOutOverflow = false;
+}
+
+static void jsonOutRaw(const char* s) {
+  size_t n = strlen(s);
+  if (g_jsonOutLen + n >= sizeof(g_jsonOut)) { g_jsonOutOverflow = true; return; }
+  memcpy(g_jsonOut + g_jsonOutLen, s, n);
+  g_jsonOutLen += n;
+}
+
+static void jsonOutDoc(const JsonDocument& d) {
+  size_t room = sizeof(g_jsonOut) - g_jsonOutLen;
+  if (measureJson(d) >= room) { g_jsonOutOverflow = true; return; }
+  g_jsonOutLen += serializeJson(d, g_jsonOut + g_jsonOutLen, room);
+}
+
+void sendJsonEnvelope(int code, bool ok, const JsonDocument* data, const char* error) {
+  jsonOutBegin();
+  jsonOutRaw(ok ? "{\"ok\":true,\"data\":" : "{\"ok\":false,\"data\":");
+  if (data) jsonOutDoc(*data);
+  else jsonOutRaw("null");
+  if (error) {
+    jsonOutRaw(",\"error\":\"");
+    jsonOutRaw(error); // error codes are plain identifiers
+    jsonOutRaw("\"}");
+  } else {
+    jsonOutRaw(",\"error\":null}");
+  }
+
+  if (g_jsonOutOverflow) {
+    LOG_ERROR("HTTP", "JSON response larger than g_jsonOut");
+    static const char TOO_LARGE[] = "{\"ok\":false,\"data\":null,\"error\":\"RESPONSE_TOO_LARGE\"}";
+    httpSendBuf(500, "application/json", TOO_LARGE, sizeof(TOO_LARGE) - 1);
+    return;
+  }
+  httpSendBuf(code, "application/json", g_jsonOut, g_jsonOutLen);
+}
+
+void sendJsonError(const char* error) {
+  sendJsonEnvelope(200, false, nullptr, error ? error : "UNKNOWN");
+}
+
+void sendJsonOkObject(const JsonDocument& dataDoc) {
+  sendJsonEnvelope(200, true, &dataDoc, nullptr);
+}
+
+static const char* contentTypeFor(const String& path) {
+  if (path.endsWith(".html")) return "text/html";
+  if (path.endsWith(".css"))  return "text/css";
+  if (path.endsWith(".js"))   return "application/javascript";
+  if (path.endsWith(".png"))  return "image/png";
+  if (path.endsWith(".jpg") || path.endsWith(".jpeg")) return "image/jpeg";
+  if (path.endsWith(".ico"))  return "image/x-icon";
+  if (path.endsWith(".svg"))  return "image/svg+xml";
+  return "text/plain";
+}
+
+// Each path is resolved against LittleFS once (gzip twin preferred) and its
+// content type + ETag kept here, so repeat hits (and repeat misses from
+// captive-portal probes) cost no filesystem lookups. LittleFS content only
+// changes by reflashing, so entries never go stale.
+static const int ASSET_CACHE_SIZE = 8;
+static StaticAsset g_assets[ASSET_CACHE_SIZE];
+static int g_assetCount = 0;
+static int g_assetNext = 0; // round-robin replacement once full
+
+static void assetComputeEtag(StaticAsset& a) {
+  File f = LittleFS.open(a.fsPath, "r");
+  uint32_t h = 2166136261UL; // FNV-1a
+  size_t size = 0;
+  uint8_t buf[256];
+  while (f && f.available()) {
+    size_t n = f.read(buf, sizeof(buf));
+    if (n == 0) break;
+    for (size_t i = 0; i < n; i++) h = (h ^ buf[i]) * 16777619UL;
+    size += n;
+  }
+  if (f) f.close();
+  snprintf(a.etag, sizeof(a.etag), "\"%08lx-%lu\"", (unsigned long)h, (unsigned long)size);
+}
+
+static const StaticAsset* assetLookup(const String& path) {
+  if (!fsReady()) return nullptr;
+  for (int i = 0; i < g_assetCount; i++) {
+    if (g_assets[i].path == path) return g_assets[i].fsPath.length() ? &g_assets[i] : nullptr;
+  }
+
+  int slot = (g_assetCount < ASSET_CACHE_SIZE) ? g_assetCount++ : (g_assetNext++ % ASSET_CACHE_SIZE);
+  StaticAsset& a = g_assets[slot];
+  a.path = path;
+  a.fsPath = "";
+  a.contentType = contentTypeFor(path);
+  a.gzip = false;
+  a.etag[0] = 0;
+
+  String gz = path + ".gz";
+  if (LittleFS.exists(gz)) {
+    a.fsPath = gz;
+    a.gzip = true;
+  } else if (LittleFS.exists(path)) {
+    a.fsPath = path;
+  } else {
+    return nullptr;
+  }
+
+  assetComputeEtag(a);
+  LOG_INFO("HTTP", "Asset cached | " + path + " -> " + a.fsPath + " etag=" + a.etag);
+  return &a;
+}
+
+bool tryServeFromLittleFS(String path) {
+  if (fsPending()) { // not a miss yet: the browser retries shortly
+    httpSendHeader("Retry-After", "1");
+    httpSend(503, "text/plain", "Starting up");
+    return true;
+  }
+  if (path.endsWith("/")) path += "index.html";
+  const StaticAsset* a = assetLookup(path);
+  if (!a) return false;
+
+  // no-cache = always revalidate; a matching ETag costs only a 304
+  httpSendHeader("ETag", a->etag);
+  httpSendHeader("Cache-Control", "no-cache");
+  if (httpHeader("If-None-Match") == a->etag) {
+    httpSend(304, a->contentType, "");
+    return true;
+  }
+  if (a->gzip) httpSendHeader("Vary", "Accept-Encoding");
+  return httpSendFile(a->fsPath, a->contentType, a->gzip);
+}
+
+void handleRoot() {
+  if (tryServeFromLittleFS("/index.html")) return;
+
+  // Minimal fallback UI if no LittleFS index.html
+  static const char FALLBACK_HTML[] =
+    "<!doctype html><html><head><meta charset='utf-8'/>"
+    "<meta name='viewport' content='width=device-width, initial-scale=1'/>"
+    "<title>CoffeeMachine</title></head><body style='font-family:Arial;padding:16px;'>"
+    "<h2>ESP32 CoffeeMachine</h2>"
+    "<p><b>No UI found.</b> Upload your UI files to LittleFS at <code>/index.html</code>.</p>"
+    "<p>API is running. Try <code>/api/status</code> in the browser.</p>"
+    "</body></html>";
+  httpSendBuf(200, "text/html", FALLBACK_HTML, sizeof(FALLBACK_HTML) - 1);
+}
+
+// Captive portal helpers
+void redirectToRoot() {
+  httpSendHeader("Location", String("http://") + AP_IP.toString() + "/");
+  httpSend(302, "text/plain", "");
+}
+
+bool isApiPath(const String& uri) {
+  return uri.startsWith("/api/");
+}
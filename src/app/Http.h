@@ -0,0 +1,63 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+// HTTP backend glue: one set of http*() calls over either the sync WebServer
+// (served from loop()) or ESPAsyncWebServer (AsyncTCP task), JSON reply
+// framing and the LittleFS static files.
+
+#include "AppConfig.h"
+#include <ArduinoJson.h>
+
+#if USE_ASYNC_HTTP
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+typedef WebRequestMethodComposite HttpMethod;
+#else
+#include <WebServer.h>
+typedef HTTPMethod HttpMethod;
+#endif
+typedef void (*HttpHandler)();
+
+#if USE_ASYNC_HTTP
+extern AsyncWebServer server;
+extern AsyncEventSource events;
+#else
+extern WebServer server;
+#endif
+
+// Guards FSM/status/settings globals when HTTP handlers run on another task.
+// With the sync backend everything runs in loop() and the lock is a no-op.
+extern SemaphoreHandle_t g_coreMutex;
+
+struct CoreLock {
+  CoreLock()  { if (USE_ASYNC_HTTP && g_coreMutex) xSemaphoreTake(g_coreMutex, portMAX_DELAY); }
+  ~CoreLock() { if (USE_ASYNC_HTTP && g_coreMutex) xSemaphoreGive(g_coreMutex); }
+};
+
+// MQTT commands: body in, reply out instead of the request (see Http.cpp)
+extern const char* g_cmdBody;
+extern const char* g_cmdReply;
+extern size_t g_cmdReplyLen;
+
+void httpSendHeader(const String& name, const String& value);
+String httpUri();
+bool httpParseBody(JsonDocument& doc); // into doc; false = no/invalid body
+void httpSendBuf(int code, const char* type, const char* buf, size_t len);
+String httpHeader(const char* name);
+String httpArg(const char* name);
+bool httpSendFile(const String& fsPath, const char* type, bool gzip);
+void httpOn(const char* uri, HttpMethod method, HttpHandler h);
+void httpOnNotFound(HttpHandler h);
+
+// {"ok":..,"data":..,"error":..}; request bodies parse into g_reqDoc
+extern StaticJsonDocument<1024> g_reqDoc;
+void sendJsonEnvelope(int code, bool ok, const JsonDocument* data, const char* error);
+void sendJsonError(const char* error);
+void sendJsonOkObject(const JsonDocument& dataDoc);
+
+bool tryServeFromLittleFS(String path);
+void handleRoot();
+void redirectToRoot();
+bool isApiPath(const String& uri);
+
+#endif
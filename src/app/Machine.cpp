@@ -0,0 +1,274 @@
+#include "Machine.h"
+#include "../core/Logger.h"
+#include "Audio.h"
+#include "Consumables.h"
+#include "OrderStats.h"
+#include <atomic>
+#include <esp_timer.h>
+
+// ---------- Relays: log, soft start, energy and stock counters ----------
+
+static const int RELAY_PINS[10] = {
+  PIN_RELAY_0, PIN_RELAY_1, PIN_RELAY_2, PIN_RELAY_3, PIN_RELAY_4,
+  PIN_RELAY_5, PIN_RELAY_6, PIN_RELAY_7, PIN_RELAY_8, PIN_RELAY_9
+};
+
+static const char* const RELAY_NAMES[10] = {
+  "Tank1Sugar", "Tank2Coffee", "Tank3Nescafe", "WaterPump", "MilkPump",
+  "InternalHeater", "ExternalHeater", "MixerRotate", "MixerUp", "MixerDown"
+};
+
+uint16_t g_relayOnMask = 0;
+
+// Energy counter since boot: RELAY_POWER_W x on-time, in W*ms (= mJ). The
+// keep-warm share is the controller's (MachineController::keepWarmEnergyWh).
+static uint32_t g_relayOnSinceMs[10];
+static uint64_t g_energyMJ = 0;
+
+int relayIndexOf(uint8_t pin) {
+  for (int i = 0; i < 10; i++) {
+    if (RELAY_PINS[i] == pin) return i;
+  }
+  return -1;
+}
+
+void energyAccount(int idx, uint32_t now) {
+  consumablesRun(idx, now - g_relayOnSinceMs[idx], now);
+  g_energyMJ += (uint64_t)RELAY_POWER_W[idx] * (now - g_relayOnSinceMs[idx]);
+  g_relayOnSinceMs[idx] = now;
+}
+
+float energyWh() {
+  uint32_t now = millis();
+  uint64_t mj = g_energyMJ;
+  for (int i = 0; i < 10; i++) {
+    if (g_relayOnMask & (1u << i)) mj += (uint64_t)RELAY_POWER_W[i] * (now - g_relayOnSinceMs[i]);
+  }
+  return mj / 3600000.0f;
+}
+
+uint32_t relayRunningMs(int idx, uint32_t now) {
+  return (g_relayOnMask & (1u << idx)) ? now - g_relayOnSinceMs[idx] : 0;
+}
+
+// Switches relay masks at once; both masks are relay indexes and must not overlap
+void MachineHal::apply(uint16_t onMask, uint16_t offMask) {
+  onMask &= (uint16_t)~g_relayOnMask;
+  offMask &= g_relayOnMask;
+  if (!onMask && !offMask) return;
+
+  uint32_t now = millis();
+  for (int i = 0; i < 10; i++) {
+    if (offMask & (1u << i)) {
+      Esp32Hal::relayOff(RELAY_PINS[i]);
+      energyAccount(i, now);
+    }
+  }
+  for (int i = 0; i < 10; i++) {
+    if (onMask & (1u << i)) {
+      Esp32Hal::relayOn(RELAY_PINS[i]);
+      g_relayOnSinceMs[i] = now;
+    }
+  }
+  g_relayOnMask = (uint16_t)((g_relayOnMask | onMask) & ~offMask);
+  if (onMask & RELAY_SOFT_START_MASK) heavyOnMs = now;
+}
+
+// Re-asserting the current level is a no-op, so the PID can call this on
+// every pass without log spam.
+void MachineHal::relaySet(int idx, bool on) {
+  if (idx < 0) return;
+  uint16_t bit = (uint16_t)(1u << idx);
+  if ((((g_relayOnMask | deferMask) & bit) != 0) == on) return;
+
+  if (!on && (deferMask & bit)) {
+    deferMask &= (uint16_t)~bit; // never energized
+    LOG_INFOF("HW", "Relay %d OFF | %s (soft start cancelled)", idx, RELAY_NAMES[idx]);
+    return;
+  }
+  if (on && RELAY_SOFT_START_MS && (bit & RELAY_SOFT_START_MASK) &&
+      (deferMask || !softStartDue(millis()))) {
+    deferMask |= bit;
+    LOG_INFOF("HW", "Relay %d deferred | %s (soft start)", idx, RELAY_NAMES[idx]);
+    return;
+  }
+
+  apply(on ? bit : 0, on ? 0 : bit);
+  LOG_INFOF("HW", "Relay %d %s | %s", idx, on ? "ON" : "OFF", RELAY_NAMES[idx]);
+}
+
+// Soft start: energizes the next deferred heavy load once the gap has passed.
+// Called every loop(); the FSM sleep is capped at LOOP_POLL_MS.
+void MachineHal::softStartPump(uint32_t now) {
+  if (!deferMask || !softStartDue(now)) return;
+  int idx = 0;
+  while (!(deferMask & (1u << idx))) idx++;
+  uint16_t bit = (uint16_t)(1u << idx);
+  deferMask &= (uint16_t)~bit;
+  apply(bit, 0);
+  LOG_INFOF("HW", "Relay %d ON | %s soft start", idx, RELAY_NAMES[idx]);
+}
+
+void MachineHal::allRelaysOff() {
+  Esp32Hal::allRelaysOff(); // first: e-stop latency is this one store
+  uint16_t was = g_relayOnMask | deferMask;
+  deferMask = 0;
+  apply(0, g_relayOnMask);
+  if (was) LOG_WARNF("HW", "ALL RELAYS OFF | mask=0x%03x", was);
+}
+
+// ---------- Core sensor task + FSM, wake scheduler, idle power ----------
+// The order FSM (recipes, queue, overlap pipeline, thermoblock PID, keep-warm,
+// auto-tune) is MachineController and the sampling is SensorTask, both from
+// src/core and shared with the native bench. The sensor task polls g_hal on
+// core 0 and publishes a seqlock snapshot; loop() runs g_machine.update() only
+// when something can have changed: the deadline the last pass asked for
+// (nextWakeMs: step timers, heater PWM edges, timeouts) or a change of the
+// inputs it watches (wakeEvents, notified by the sensor task). A one-shot
+// esp_timer fires at the deadline; either wakes loop() out of
+// ulTaskNotifyTake(). The snapshot is compared once more after the waiter is
+// registered, so a change that lands mid-pass is never lost. Code that changes
+// the machine outside a pass (HTTP handlers, MQTT commands) calls fsmWake().
+//
+// Idle power mode is the controller's (IDLE_POWER_SAVE): the softAP forbids
+// Wi-Fi modem- and light-sleep, so it scales the CPU clock and slows the
+// sensor rates. Every HTTP request and MQTT command calls powerActivity()
+// first, so the request, and the order it may start, run at CPU_MHZ_ACTIVE.
+
+SettingsManager g_settings;
+MachineHal g_hal;
+SensorTask g_sensors(g_hal);
+MachineController g_machine(g_hal, g_sensors, g_settings);
+
+const char* machineError() {
+  const char* err = g_machine.getError();
+  return *err ? err : nullptr;
+}
+
+TaskHandle_t g_fsmTask = nullptr;
+static esp_timer_handle_t g_fsmTimer = nullptr;
+static std::atomic<bool> g_fsmKick(true);        // run the next pass now
+static SensorSnapshot g_fsmSeen;                 // read before the last pass
+
+void fsmWake() {
+  g_fsmKick.store(true);
+  if (g_fsmTask) xTaskNotifyGive(g_fsmTask);
+}
+
+static void fsmTimerFire(void*) {
+  if (g_fsmTask) xTaskNotifyGive(g_fsmTask);
+}
+
+// Cycle counts in perfEnd() follow the clock the controller picked
+static void perfClockSync() {
+  perfSetMhz(g_machine.isPowerSave() ? CPU_MHZ_IDLE : CPU_MHZ_ACTIVE);
+}
+
+void powerActivity() {
+  g_machine.noteActivity();
+  perfClockSync();
+}
+
+// Arms the exact wake-up at the deadline of the last pass
+static void fsmArmTimer(uint32_t now) {
+  if (!g_fsmTimer) return;
+  esp_timer_stop(g_fsmTimer);
+  int32_t left = (int32_t)(g_machine.nextWakeMs() - now);
+  if (left > 0) esp_timer_start_once(g_fsmTimer, (uint64_t)left * 1000ULL);
+}
+
+void fsmSleep(uint32_t capMs) {
+  if (g_fsmKick.load()) return;
+  int32_t left = (int32_t)(g_machine.nextWakeMs() - millis());
+  if (left <= 0) return;
+  uint32_t ms = (uint32_t)left < capMs ? (uint32_t)left : capMs;
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms));
+}
+
+// ---------- Order events: stats, stock check, prompts (MachineObserver) ----------
+
+bool g_statusDirty = true;
+static uint32_t g_stateSinceMs = 0;
+
+static uint16_t stateAudioTrack(MachineState s) {
+  switch (s) {
+    case VALIDATE:    return AUDIO_TRACK_START;
+    case DONE:        return AUDIO_TRACK_DONE;
+    case ERROR_STATE: return AUDIO_TRACK_ERROR;
+    default:          return 0;
+  }
+}
+
+// First tracked consumable the plan's timed steps would run dry, or -1. Only
+// the stock check: the order is refused at VALIDATE rather than stopping
+// halfway with an empty hopper.
+static int planShortConsumable(const PlannedStep* plan, uint8_t n) {
+  uint32_t needMs[CONS_COUNT] = {0};
+  for (uint8_t i = 0; i < n; i++) {
+    int r = relayIndexOf(plan[i].relay);
+    if (r >= 0 && r < CONS_COUNT && plan[i].end == END_TIMER) needMs[r] += plan[i].durMs;
+  }
+  for (uint8_t c = 0; c < CONS_COUNT; c++) {
+    if (needMs[c] == 0 || g_cons[c].perSec <= 0) continue;
+    if (consumableRemaining(c, needMs[c]) < 0) return c;
+  }
+  return -1;
+}
+
+class MachineEvents : public MachineObserver {
+public:
+  void onState(MachineState from, MachineState to) override {
+    uint32_t now = millis();
+    statsOnState(from, to, machineError(), g_stateSinceMs, now);
+    g_stateSinceMs = now;
+    g_statusDirty = true;
+    if (to == DONE && from != AUTOTUNE) consumablesOrderDone(now); // every relay is off
+    audioPrompt(stateAudioTrack(to)); // queued, never waits on the UART
+  }
+
+  void onOrderStart(uint16_t, const OrderParams& o) override {
+    consumablesOrderBegin();
+    statsOrderBegin(o.mode, millis());
+  }
+
+  const char* checkPlan(const PlannedStep* plan, uint8_t n) override {
+    int c = planShortConsumable(plan, n);
+    if (c < 0) return nullptr;
+    LOG_WARNF("FSM", "Not enough %s | %.0f%s left", CONS_NAMES[c], consumableRemaining((uint8_t)c, 0), CONS_UNITS[c]);
+    return "LOW_STOCK";
+  }
+};
+
+static MachineEvents g_machineEvents;
+
+// Only when kicked or g_machine.wakeDue(): deadline, or a watched input changed
+void fsmPass() {
+  SensorSnapshot cur;
+  g_sensors.read(cur);
+  if (!g_fsmKick.load() && !g_machine.wakeDue(millis(), g_fsmSeen, cur)) return;
+  g_fsmKick.store(false);
+
+  g_fsmSeen = cur;
+  uint32_t t0 = perfStart();
+  g_machine.update();
+  perfEnd(PERF_FSM, t0);
+  perfClockSync();
+  g_sensors.notifyOnChange(g_fsmTask, g_machine.wakeEvents());
+  fsmArmTimer(millis());
+
+  // A watched input that changed after update() read it is handled now
+  g_sensors.read(cur);
+  if (g_machine.wakeDue(millis(), g_fsmSeen, cur)) g_fsmKick.store(true);
+}
+
+void machineBegin() {
+  g_machine.setObserver(&g_machineEvents);
+  g_fsmTask = xTaskGetCurrentTaskHandle();
+  esp_timer_create_args_t args = {};
+  args.callback = fsmTimerFire;
+  args.name = "fsm";
+  if (esp_timer_create(&args, &g_fsmTimer) != ESP_OK) {
+    g_fsmTimer = nullptr;
+    LOG_ERROR("BOOT", "FSM timer create failed (FSM falls back to LOOP_POLL_MS polling)");
+  }
+}
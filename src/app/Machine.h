@@ -0,0 +1,90 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+// The drink machine: core HAL, sensor task and order FSM plus what only this
+// firmware keeps around them (relay log, soft start, energy and stock
+// counters, stats, prompts), and the loop() wake scheduler.
+
+#include "../core/Esp32Hal.h"
+#include "../core/MachineController.h"
+#include "../core/SensorTask.h"
+#include "../core/SettingsManager.h"
+#include "AppConfig.h"
+#include "Perf.h"
+#include <Arduino.h>
+
+// Relay index of a RELAY_* pin (the FSM switches pins), -1 if none
+int relayIndexOf(uint8_t pin);
+
+// ---------- Relay bank + sensors ----------
+// Esp32Hal drives the relays through the GPIO set/clear registers (offs
+// first, all ten in one store per bank on allRelaysOff()) and owns the
+// ultrasonic echo ISR, the debounced limit switches and the MAX6675 bus.
+// MachineHal adds what only this firmware keeps per relay index: energy and
+// stock counters, the relay log and the soft start, plus the sensor-task
+// timing slots for /api/diag.
+class MachineHal : public Esp32Hal {
+public:
+  void relayOn(uint8_t pin) override { relaySet(relayIndexOf(pin), true); }
+  void relayOff(uint8_t pin) override { relaySet(relayIndexOf(pin), false); }
+  void allRelaysOff() override;
+  void softStartPump(uint32_t now);
+
+  // Sensor task (core 0)
+  bool cupPresent() override {
+    uint32_t t0 = perfStart();
+    bool present = Esp32Hal::cupPresent();
+    perfEnd(PERF_CUP, t0);
+    return present;
+  }
+  bool readLimitUpper() override { return timedLimit(LIMIT_UPPER); }
+  bool readLimitLower() override { return timedLimit(LIMIT_LOWER); }
+  void pollThermocouples() override {
+    uint32_t t0 = perfStart();
+    Esp32Hal::pollThermocouples();
+    perfEnd(PERF_TEMP, t0);
+  }
+
+private:
+  uint16_t deferMask = 0; // soft start: requested on, not yet energized
+  uint32_t heavyOnMs = 0; // last heavy load switched on
+
+  void apply(uint16_t onMask, uint16_t offMask);
+  void relaySet(int idx, bool on);
+  bool softStartDue(uint32_t now) const { return now - heavyOnMs >= RELAY_SOFT_START_MS; }
+  bool timedLimit(uint8_t pin) { // one PERF_LIMITS sample per switch
+    uint32_t t0 = perfStart();
+    bool pressed = pin == LIMIT_UPPER ? Esp32Hal::readLimitUpper() : Esp32Hal::readLimitLower();
+    perfEnd(PERF_LIMITS, t0);
+    return pressed;
+  }
+};
+
+extern SettingsManager g_settings;
+extern MachineHal g_hal;
+extern SensorTask g_sensors;
+extern MachineController g_machine;
+
+extern uint16_t g_relayOnMask; // bit i = relay i energized
+float energyWh();              // since boot, includes relays that are on right now
+void energyAccount(int idx, uint32_t now);
+uint32_t relayRunningMs(int idx, uint32_t now); // on-time not yet counted by energyAccount()
+
+// Current error code, nullptr when none (JSON null)
+const char* machineError();
+
+// loop() still polls the sync WebServer, SSE and the trace this often between passes
+static const uint32_t LOOP_POLL_MS = USE_ASYNC_HTTP ? 20 : 1;
+
+extern TaskHandle_t g_fsmTask; // loop() task
+extern bool g_statusDirty;     // state changed since last status push
+
+// Hooks the order events into g_machine and starts the wake scheduler. Call
+// from loop()'s task (setup() runs in it too).
+void machineBegin();
+void fsmWake();               // after changing the machine outside a pass
+void fsmPass();               // from loop(), if a deadline or a watched sensor event is due
+void fsmSleep(uint32_t capMs); // until the next deadline, a wake notification, or capMs
+void powerActivity();         // before each HTTP request / MQTT command
+
+#endif
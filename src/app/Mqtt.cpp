@@ -0,0 +1,247 @@
+#include "Mqtt.h"
+#include "../core/Logger.h"
+#include "Api.h"
+#include "AppConfig.h"
+#include "Http.h"
+#include "Machine.h"
+#include "StatusPush.h"
+#include <WiFi.h>
+#include <mqtt_client.h>
+
+// Only with STA_SSID set. esp-mqtt (part of ESP-IDF, so no extra library)
+// keeps the session in its own task and reconnects on its own; loop() never
+// waits on the network, it only enqueues. Topics under <MQTT_TOPIC_ROOT>/<id>,
+// id = the last three MAC bytes in hex:
+//   online  "1", or "0" as the last will; retained
+//   status  the /api/status data object, retained, QoS 0, on every status
+//           change (g_statusSeq) but at most once per MQTT_STATUS_MIN_MS
+//   order   {"id","mode","result","ms","energyWh"} when an order ends, QoS 1.
+//           Held in a RAM backlog of MQTT_BACKLOG records while the broker is
+//           away (oldest dropped when full); sent one at a time, a record only
+//           leaves the backlog on its PUBACK. Resending is esp-mqtt's: the
+//           head sits in its outbox (store=true) until acknowledged, across
+//           reconnects, and is only enqueued again if the outbox expires it
+//   cmd     {"cmd":"start", <POST /api/start fields>} or {"cmd":"stop"}, an
+//           optional "ref" (up to 15 chars) names the reply topic
+//   reply   reply/<ref>, or reply: the envelope the REST call returns
+// The client task only copies a command into g_mqttCmdQueue; mqttPump()
+// runs it through the HTTP shim, so it takes apiStart()/apiStop()'s path.
+
+static const uint32_t MQTT_STATUS_MIN_MS = 1000;
+static const int MQTT_KEEPALIVE_S = 30;
+static const int MQTT_QOS_STATUS = 0;
+static const int MQTT_QOS_ORDER = 1;
+static const uint8_t MQTT_BACKLOG = 16;
+static const size_t MQTT_ORDER_JSON_MAX = 160;
+static const size_t MQTT_CMD_MAX = 384;
+static const UBaseType_t MQTT_CMD_QUEUE_LEN = 2;
+
+std::atomic<bool> g_mqttUp(false);
+std::atomic<uint32_t> g_mqttCmdDropped(0);
+uint32_t g_mqttOrdersSent = 0;
+uint32_t g_mqttOrdersLost = 0;
+uint8_t g_mqttBacklogLen = 0;
+bool g_mqttOrderStopped = false;
+
+static esp_mqtt_client_handle_t g_mqtt = nullptr;
+static QueueHandle_t g_mqttCmdQueue = nullptr;
+static char g_mqttBase[32];                      // "<root>/<id>"
+static char g_mqttWill[40];                      // "<root>/<id>/online"
+static bool g_mqttWasUp = false;
+static uint32_t g_mqttStatusSeq = 0;             // last published g_statusSeq
+static uint32_t g_mqttStatusMs = 0;
+
+static char g_mqttBacklog[MQTT_BACKLOG][MQTT_ORDER_JSON_MAX];
+static uint8_t g_mqttBacklogHead = 0;
+static std::atomic<int> g_mqttInflight(-1);      // msg_id of the backlog head once enqueued
+static std::atomic<int> g_mqttInflightAck(-1);   // g_mqttInflight once acknowledged
+static std::atomic<int> g_mqttInflightLost(-1);  // g_mqttInflight once the outbox expired it
+
+static uint16_t g_mqttOrder = 0;                 // order being tracked, 0 = none
+static uint32_t g_mqttOrderMs = 0;
+static float g_mqttOrderWh0 = 0;
+
+static void mqttTopic(char* buf, size_t cap, const char* leaf) {
+  snprintf(buf, cap, "%s/%s", g_mqttBase, leaf);
+}
+
+// Client task
+static void mqttEvent(void*, esp_event_base_t, int32_t id, void* data) {
+  esp_mqtt_event_handle_t e = (esp_mqtt_event_handle_t)data;
+  char topic[48];
+  switch ((esp_mqtt_event_id_t)id) {
+    case MQTT_EVENT_CONNECTED:
+      mqttTopic(topic, sizeof(topic), "cmd");
+      esp_mqtt_client_subscribe(g_mqtt, topic, 1);
+      esp_mqtt_client_enqueue(g_mqtt, g_mqttWill, "1", 1, 1, 1, true);
+      g_mqttUp.store(true);
+      break;
+    case MQTT_EVENT_DISCONNECTED:
+      g_mqttUp.store(false);
+      break;
+    case MQTT_EVENT_PUBLISHED: // online and command replies are QoS 1 too: match the head only
+      if (e->msg_id == g_mqttInflight.load()) g_mqttInflightAck.store(e->msg_id);
+      break;
+    case MQTT_EVENT_DELETED:
+      if (e->msg_id == g_mqttInflight.load()) g_mqttInflightLost.store(e->msg_id);
+      break;
+    case MQTT_EVENT_DATA: {
+      int n = e->data_len;
+      if (e->current_data_offset != 0 || n != e->total_data_len || n >= (int)MQTT_CMD_MAX) {
+        g_mqttCmdDropped.fetch_add(1); // commands are small: no reassembly
+        break;
+      }
+      char cmd[MQTT_CMD_MAX];
+      memcpy(cmd, e->data, n);
+      cmd[n] = 0;
+      if (xQueueSend(g_mqttCmdQueue, cmd, 0) != pdTRUE) g_mqttCmdDropped.fetch_add(1);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void mqttBegin() {
+  if (!STA_SSID[0]) return;
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(g_mqttBase, sizeof(g_mqttBase), "%s/%02x%02x%02x", MQTT_TOPIC_ROOT, mac[3], mac[4], mac[5]);
+  mqttTopic(g_mqttWill, sizeof(g_mqttWill), "online");
+
+  g_mqttCmdQueue = xQueueCreate(MQTT_CMD_QUEUE_LEN, MQTT_CMD_MAX);
+  esp_mqtt_client_config_t cfg = {};
+#if ESP_IDF_VERSION_MAJOR >= 5
+  cfg.broker.address.uri = MQTT_URI;
+  cfg.credentials.client_id = g_mqttBase;
+  if (MQTT_USER[0]) cfg.credentials.username = MQTT_USER;
+  if (MQTT_PASS[0]) cfg.credentials.authentication.password = MQTT_PASS;
+  cfg.session.keepalive = MQTT_KEEPALIVE_S;
+  cfg.session.last_will.topic = g_mqttWill;
+  cfg.session.last_will.msg = "0";
+  cfg.session.last_will.qos = 1;
+  cfg.session.last_will.retain = 1;
+#else
+  cfg.uri = MQTT_URI;
+  cfg.client_id = g_mqttBase;
+  if (MQTT_USER[0]) cfg.username = MQTT_USER;
+  if (MQTT_PASS[0]) cfg.password = MQTT_PASS;
+  cfg.keepalive = MQTT_KEEPALIVE_S;
+  cfg.lwt_topic = g_mqttWill;
+  cfg.lwt_msg = "0";
+  cfg.lwt_qos = 1;
+  cfg.lwt_retain = 1;
+#endif
+  g_mqtt = g_mqttCmdQueue ? esp_mqtt_client_init(&cfg) : nullptr;
+  if (!g_mqtt) {
+    LOG_ERROR("NET", "MQTT client init failed, uplink off");
+    return;
+  }
+  esp_mqtt_client_register_event(g_mqtt, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, mqttEvent, nullptr);
+  esp_mqtt_client_start(g_mqtt);
+  LOG_INFO("NET", String("MQTT started | ") + MQTT_URI + " topics=" + g_mqttBase + "/");
+}
+
+static void mqttBacklogPush(const char* json) {
+  if (g_mqttBacklogLen == MQTT_BACKLOG) { // drop the oldest
+    g_mqttBacklogHead = (uint8_t)((g_mqttBacklogHead + 1) % MQTT_BACKLOG);
+    g_mqttBacklogLen--;
+    g_mqttInflight.store(-1); // a late PUBACK for it no longer pops the new head
+    g_mqttOrdersLost++;
+  }
+  uint8_t slot = (uint8_t)((g_mqttBacklogHead + g_mqttBacklogLen) % MQTT_BACKLOG);
+  strlcpy(g_mqttBacklog[slot], json, MQTT_ORDER_JSON_MAX);
+  g_mqttBacklogLen++;
+}
+
+// Order end (same edge as the trace recorder) -> one backlog record
+static void mqttTrackOrder(uint32_t now) {
+  bool ordering = g_machine.isBusy() && g_machine.currentState() != AUTOTUNE;
+  if (ordering && g_mqttOrder == 0) {
+    g_mqttOrder = g_machine.runningId();
+    g_mqttOrderMs = now;
+    g_mqttOrderWh0 = energyWh();
+    g_mqttOrderStopped = false;
+  }
+  if (ordering || g_mqttOrder == 0) return;
+
+  const char* result = machineError() ? machineError() : (g_mqttOrderStopped ? "STOPPED" : "OK");
+  char json[MQTT_ORDER_JSON_MAX];
+  snprintf(json, sizeof(json), "{\"id\":%u,\"mode\":\"%s\",\"result\":\"%s\",\"ms\":%lu,\"energyWh\":%.2f}",
+           g_mqttOrder, g_machine.recipeFor(g_machine.runningOrder()).name, result, (unsigned long)(now - g_mqttOrderMs),
+           energyWh() - g_mqttOrderWh0);
+  mqttBacklogPush(json);
+  g_mqttOrder = 0;
+}
+
+static void mqttRunCommand(const char* body) {
+  char ref[16] = "";
+  const char* name = "?";
+  HttpHandler h = nullptr;
+  g_reqDoc.clear();
+  if (!deserializeJson(g_reqDoc, body)) {
+    const char* c = g_reqDoc["cmd"].as<const char*>();
+    const char* r = g_reqDoc["ref"].as<const char*>();
+    if (r) strlcpy(ref, r, sizeof(ref));
+    if (c && strcmp(c, "start") == 0) h = apiStart, name = "start";
+    else if (c && strcmp(c, "stop") == 0) h = apiStop, name = "stop";
+  }
+  LOG_INFOF("API", "MQTT command | %s%s%s", name, ref[0] ? " ref=" : "", ref);
+
+  powerActivity();
+  g_cmdBody = body;
+  g_cmdReplyLen = 0;
+  if (h) h();
+  else sendJsonError("BAD_PARAMS");
+  g_cmdBody = nullptr;
+  fsmWake(); // as after an HTTP handler
+
+  char topic[64];
+  if (ref[0]) snprintf(topic, sizeof(topic), "%s/reply/%s", g_mqttBase, ref);
+  else mqttTopic(topic, sizeof(topic), "reply");
+  if (g_cmdReplyLen) esp_mqtt_client_enqueue(g_mqtt, topic, g_cmdReply, (int)g_cmdReplyLen, 1, 0, true);
+}
+
+// From loop() under CoreLock, after ssePump() has updated g_statusSeq
+void mqttPump(uint32_t now) {
+  if (!g_mqtt) return;
+  mqttTrackOrder(now);
+
+  char cmd[MQTT_CMD_MAX];
+  while (xQueueReceive(g_mqttCmdQueue, cmd, 0) == pdTRUE) mqttRunCommand(cmd);
+
+  bool up = g_mqttUp.load();
+  if (up != g_mqttWasUp) {
+    g_mqttWasUp = up;
+    g_mqttStatusSeq = 0; // retained status refreshed on every (re)connect
+    LOG_INFOF("NET", "MQTT %s | backlog=%u", up ? "connected" : "disconnected", g_mqttBacklogLen);
+  }
+  if (!up) return;
+
+  char topic[48];
+  if (g_mqttStatusSeq != g_statusSeq && now - g_mqttStatusMs >= MQTT_STATUS_MIN_MS) {
+    char json[SSE_JSON_MAX];
+    size_t len = sseBuildStatusJson(json, sizeof(json));
+    mqttTopic(topic, sizeof(topic), "status");
+    if (esp_mqtt_client_enqueue(g_mqtt, topic, json, (int)len, MQTT_QOS_STATUS, 1, true) >= 0) {
+      g_mqttStatusSeq = g_statusSeq;
+      g_mqttStatusMs = now;
+    }
+  }
+
+  int inflight = g_mqttInflight.load();
+  if (inflight >= 0 && g_mqttInflightAck.load() == inflight) {
+    g_mqttBacklogHead = (uint8_t)((g_mqttBacklogHead + 1) % MQTT_BACKLOG);
+    g_mqttBacklogLen--;
+    inflight = -1;
+    g_mqttOrdersSent++;
+  } else if (inflight >= 0 && g_mqttInflightLost.load() == inflight) {
+    inflight = -1; // expired unacknowledged: same record again
+  }
+  if (inflight < 0 && g_mqttBacklogLen) {
+    mqttTopic(topic, sizeof(topic), "order");
+    const char* json = g_mqttBacklog[g_mqttBacklogHead];
+    inflight = esp_mqtt_client_enqueue(g_mqtt, topic, json, (int)strlen(json), MQTT_QOS_ORDER, 0, true);
+  }
+  g_mqttInflight.store(inflight);
+}
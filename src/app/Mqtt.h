@@ -0,0 +1,21 @@
+#ifndef MQTT_H
+#define MQTT_H
+
+// Optional uplink to an MQTT broker (esp-mqtt): status, finished orders and
+// start/stop commands. See Mqtt.cpp for the topics.
+
+#include <Arduino.h>
+#include <atomic>
+
+void mqttBegin();            // setup(), after Wi-Fi; no-op without STA_SSID
+void mqttPump(uint32_t now); // loop(), under CoreLock
+
+// Uplink state for /api/diag; the client task writes the atomics
+extern std::atomic<bool> g_mqttUp;         // broker session open
+extern std::atomic<uint32_t> g_mqttCmdDropped; // fragmented, oversize or queue full
+extern uint32_t g_mqttOrdersSent;          // loop() only
+extern uint32_t g_mqttOrdersLost;          // backlog overflow, loop() only
+extern uint8_t g_mqttBacklogLen;           // loop() only
+extern bool g_mqttOrderStopped;            // set by apiStop(): SAFE_STOP is gone by the next pump
+
+#endif
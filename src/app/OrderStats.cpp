@@ -0,0 +1,138 @@
+#include "OrderStats.h"
+#include "../core/Crc32.h"
+#include "../core/Logger.h"
+#include "Consumables.h"
+#include "Storage.h"
+#include <stddef.h>
+
+// The machine observer (Machine.cpp) hands every state change of a running
+// order to statsOnState(),
+// which adds the time spent in the state being left to that order's VALIDATE..
+// MIX_UP slots (the reported state is the leading pipeline phase, so the slots
+// add up to the order's wall time). When the order ends, a DONE order adds each
+// visited state and the total to its mode's histograms; every order counts
+// once under its result. Saved in the "stats" blob with the consumables'
+// idle-commit rule; the last order's breakdown is kept in RAM only.
+static const char* const STATS_BLOB_KEY = "stats";
+static const uint16_t STATS_BLOB_VERSION = 2; // 2: slots in MachineController state order
+
+// Upper bucket edges; the last bucket is everything above 90 s
+const uint32_t STATS_BUCKET_MS[STATS_BUCKETS - 1] = {
+  1000, 2000, 5000, 10000, 20000, 30000, 45000, 60000, 90000
+};
+const char* const STATS_MODE_NAMES[STATS_MODES] = {"Coffee", "HotWater", "Nescafe", "Cleaning", "Custom"};
+const char* const STATS_RESULT_NAMES[STATS_RESULTS] = {
+  "OK", "STOPPED", "NO_CUP", "NO_CUP_DURING_RUN", "HEAT_TIMEOUT", "TIMEOUT_LIMIT", "LIMIT_INVALID",
+  "OVERTEMP", "SENSOR_FAIL", "LOW_STOCK", "BAD_PARAMS", "PIPELINE_STALL", "OTHER"
+};
+
+StatsBlob g_statsBlob;                 // framed in place on commit
+static bool g_statsActive = false;     // an order is between its start and its end
+static uint8_t g_statsMode = 0;        // STATS_MODE_NAMES index
+static uint32_t g_statsOrderStartMs = 0;
+static uint32_t g_statsCurMs[STATS_PHASES];
+uint8_t g_statsLastResult = STATS_RESULTS;
+uint8_t g_statsLastMode = 0;
+uint32_t g_statsLastMs[STATS_PHASES + 1];
+static uint32_t g_statsDirtySinceMs = 0;          // 0 = clean
+static uint32_t g_statsChangedMs = 0;
+
+static void statsMarkDirty(uint32_t now) {
+  g_statsChangedMs = now;
+  if (g_statsDirtySinceMs == 0) g_statsDirtySinceMs = now | 1;
+}
+
+static void statsSeriesAdd(StatsSeries& st, uint32_t ms) {
+  uint8_t b = 0;
+  while (b < STATS_BUCKETS - 1 && ms > STATS_BUCKET_MS[b]) b++;
+  st.count++;
+  st.sumMs += ms;
+  if (st.hist[b] != 0xFFFF) st.hist[b]++;
+}
+
+static bool statsReadBlob() {
+  if (!prefs.isKey(STATS_BLOB_KEY)) return false;
+  if (prefs.getBytesLength(STATS_BLOB_KEY) != sizeof(g_statsBlob) ||
+      prefs.getBytes(STATS_BLOB_KEY, &g_statsBlob, sizeof(g_statsBlob)) != sizeof(g_statsBlob)) {
+    LOG_ERROR("SETTINGS", "Stats blob unreadable, starting empty");
+    return false;
+  }
+  if (g_statsBlob.version != STATS_BLOB_VERSION || g_statsBlob.size != sizeof(g_statsBlob.m) ||
+      crc32Update(0, (const uint8_t*)&g_statsBlob, offsetof(StatsBlob, crc)) != g_statsBlob.crc) {
+    LOG_ERROR("SETTINGS", "Stats blob invalid, starting empty");
+    return false;
+  }
+  return true;
+}
+
+void statsCommit() {
+  g_statsDirtySinceMs = 0;
+  g_statsBlob.version = STATS_BLOB_VERSION;
+  g_statsBlob.size = sizeof(g_statsBlob.m);
+  g_statsBlob.crc = crc32Update(0, (const uint8_t*)&g_statsBlob, offsetof(StatsBlob, crc));
+  if (prefs.putBytes(STATS_BLOB_KEY, &g_statsBlob, sizeof(g_statsBlob)) != sizeof(g_statsBlob)) {
+    LOG_ERROR("SETTINGS", "NVS write failed, stats not persisted");
+    return;
+  }
+  LOG_DEBUG("SETTINGS", "Saved order stats to NVS");
+}
+
+void statsClear() {
+  memset(&g_statsBlob, 0, sizeof(g_statsBlob));
+}
+
+void statsLoad() {
+  if (!statsReadBlob()) statsClear();
+  uint32_t orders = 0;
+  for (uint8_t m = 0; m < STATS_MODES; m++) {
+    for (uint8_t r = 0; r < STATS_RESULTS; r++) orders += g_statsBlob.m[m].results[r];
+  }
+  LOG_INFOF("SETTINGS", "Loaded order stats | %lu orders", (unsigned long)orders);
+}
+
+void statsOrderBegin(DrinkMode mode, uint32_t now) {
+  g_statsActive = true;
+  g_statsMode = mode >= MODE_COFFEE && mode <= MODE_CUSTOM ? mode - MODE_COFFEE : STATS_MODES - 1;
+  g_statsOrderStartMs = now;
+  memset(g_statsCurMs, 0, sizeof(g_statsCurMs));
+}
+
+// Error codes without a slot of their own count as OTHER
+static uint8_t statsResultOf(MachineState to, const char* error) {
+  if (to == DONE) return 0;
+  if (to == SAFE_STOP) return 1;
+  const char* err = to == ERROR_STATE ? error : nullptr;
+  for (uint8_t i = 2; err && i < STATS_RESULTS - 1; i++) {
+    if (strcmp(err, STATS_RESULT_NAMES[i]) == 0) return i;
+  }
+  return STATS_RESULTS - 1;
+}
+
+void statsOnState(MachineState from, MachineState to, const char* error, uint32_t fromMs, uint32_t now) {
+  if (!g_statsActive) return;
+  if (from >= VALIDATE && from <= MIX_UP) g_statsCurMs[from - VALIDATE] += now - fromMs;
+  if (to >= VALIDATE && to <= MIX_UP) return;
+
+  g_statsActive = false;
+  uint8_t result = statsResultOf(to, error);
+  ModeStats& ms = g_statsBlob.m[g_statsMode];
+  ms.results[result]++;
+  if (result == 0) {
+    for (uint8_t i = 0; i < STATS_PHASES; i++) {
+      if (g_statsCurMs[i]) statsSeriesAdd(ms.phase[i], g_statsCurMs[i]);
+    }
+    statsSeriesAdd(ms.total, now - g_statsOrderStartMs);
+  }
+  g_statsLastResult = result;
+  g_statsLastMode = g_statsMode;
+  memcpy(g_statsLastMs, g_statsCurMs, sizeof(g_statsCurMs));
+  g_statsLastMs[STATS_PHASES] = now - g_statsOrderStartMs;
+  statsMarkDirty(now);
+}
+
+void statsFlushIfDue(uint32_t now, bool busy) {
+  if (g_statsDirtySinceMs == 0) return;
+  bool idleLongEnough = !busy && now - g_statsChangedMs >= CONS_COMMIT_IDLE_MS;
+  if (!idleLongEnough && now - g_statsDirtySinceMs < CONS_COMMIT_MAX_MS) return;
+  statsCommit();
+}
@@ -0,0 +1,51 @@
+#ifndef ORDER_STATS_H
+#define ORDER_STATS_H
+
+// Order statistics: wall time per reported state of each finished order, per
+// DrinkMode, in fixed buckets; results of all orders by error code.
+
+#include "../core/MachineController.h"
+#include <Arduino.h>
+
+static const uint8_t STATS_MODES = MODE_CUSTOM - MODE_COFFEE + 1; // index = mode - MODE_COFFEE
+static const uint8_t STATS_PHASES = MIX_UP - VALIDATE + 1;        // VALIDATE..MIX_UP
+static const uint8_t STATS_BUCKETS = 10;
+static const uint8_t STATS_RESULTS = 13;                         // STATS_RESULT_NAMES
+
+struct StatsSeries {
+  uint32_t count;
+  uint64_t sumMs;
+  uint16_t hist[STATS_BUCKETS]; // saturate at 65535
+};
+
+struct ModeStats {
+  StatsSeries total;                 // VALIDATE to DONE
+  StatsSeries phase[STATS_PHASES];   // index = state - VALIDATE
+  uint32_t results[STATS_RESULTS];
+};
+
+struct StatsBlob {
+  uint16_t version;  // STATS_BLOB_VERSION
+  uint16_t size;     // sizeof(m) when written
+  ModeStats m[STATS_MODES];
+  uint32_t crc;      // CRC-32 of the bytes before it
+};
+
+extern const uint32_t STATS_BUCKET_MS[STATS_BUCKETS - 1]; // upper edges; the last bucket is open
+extern const char* const STATS_MODE_NAMES[STATS_MODES];
+extern const char* const STATS_RESULT_NAMES[STATS_RESULTS];
+
+extern StatsBlob g_statsBlob; // .m is the live data
+extern uint8_t g_statsLastResult; // STATS_RESULTS = no order yet
+extern uint8_t g_statsLastMode;
+extern uint32_t g_statsLastMs[STATS_PHASES + 1]; // last order; [STATS_PHASES] = total
+
+void statsLoad(); // After prefs.begin() in setup()
+void statsClear();
+void statsCommit();
+void statsFlushIfDue(uint32_t now, bool busy); // From loop(), under CoreLock
+void statsOrderBegin(DrinkMode mode, uint32_t now);
+// On every state change; fromMs = when from began, error = the new error code
+void statsOnState(MachineState from, MachineState to, const char* error, uint32_t fromMs, uint32_t now);
+
+#endif
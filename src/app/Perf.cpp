@@ -0,0 +1,129 @@
+#include "Perf.h"
+#include <atomic>
+#include <esp_timer.h>
+
+// ---------- Boot timing ----------
+// setup() brings the portal up first; LittleFS mounts in a boot task and the
+// DFPlayer is polled from loop(), so those stages finish after "ready".
+const char* const BOOT_STAGE_NAMES[BOOT_STAGE_COUNT] = {
+  "log", "pins", "settings", "sensors", "wifi", "http", "littlefs", "recipes", "dfplayer"
+};
+BootStage g_boot[BOOT_STAGE_COUNT];
+uint32_t g_bootReadyUs = 0;
+
+void bootBegin(BootStageId id) {
+  g_boot[id].startUs = (uint32_t)esp_timer_get_time();
+}
+
+void bootEnd(BootStageId id) {
+  g_boot[id].durUs = (uint32_t)esp_timer_get_time() - g_boot[id].startUs;
+  g_boot[id].done = true;
+}
+
+bool bootAllDone() {
+  for (uint8_t i = 0; i < BOOT_STAGE_COUNT; i++) {
+    if (!g_boot[i].done) return false;
+  }
+  return true;
+}
+
+// ---------- Hot-path timing ----------
+// perfStart()/perfEnd() time one call with the CPU cycle counter and keep
+// count/min/max/sum plus a histogram (bins sqrt(2) apart) for p99, since boot
+// or the last /api/diag?reset=1. A slot has one writer task at a time; the
+// spinlock keeps readers from seeing half an update. Durations include any
+// preemption while the call ran.
+static const char* const PERF_NAMES[PERF_API] = {
+  "loop", "dns", "http", "fsm", "cup", "limits", "temp"
+};
+
+struct PerfStat {
+  uint32_t count;
+  uint32_t minNs;
+  uint32_t maxNs;
+  uint64_t sumNs;
+  uint16_t bins[PERF_BINS]; // halved together when one saturates
+};
+
+static PerfStat g_perf[PERF_COUNT];
+static char g_perfApiNames[PERF_API_SLOTS][32]; // "GET /api/status"
+static uint8_t g_perfApiCount = 0;
+static std::atomic<uint32_t> g_perfMhz(240); // perfSetMhz(), from the idle power mode
+static portMUX_TYPE g_perfMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t perfBin(uint32_t ns) {
+  if (ns < 256) return 0;
+  int msb = 31 - __builtin_clz(ns);
+  int b = 1 + (msb - 8) * 2 + ((ns >> (msb - 1)) & 1);
+  return b < PERF_BINS ? b : PERF_BINS - 1;
+}
+
+// Upper edge of bin b (ns)
+static uint32_t perfBinTop(uint8_t b) {
+  if (b == 0) return 256;
+  int msb = (b - 1) / 2 + 8;
+  return ((b - 1) & 1) ? (2u << msb) : (3u << (msb - 1));
+}
+
+void perfEnd(uint8_t id, uint32_t startCycles) {
+  if (id >= PERF_COUNT) return;
+  uint64_t ns = (uint64_t)(ESP.getCycleCount() - startCycles) * 1000 / g_perfMhz.load();
+  uint32_t v = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+  uint8_t b = perfBin(v);
+
+  PerfStat& st = g_perf[id];
+  portENTER_CRITICAL(&g_perfMux);
+  if (st.count == 0 || v < st.minNs) st.minNs = v;
+  if (v > st.maxNs) st.maxNs = v;
+  st.count++;
+  st.sumNs += v;
+  if (++st.bins[b] == UINT16_MAX) {
+    for (uint8_t i = 0; i < PERF_BINS; i++) st.bins[i] >>= 1;
+  }
+  portEXIT_CRITICAL(&g_perfMux);
+}
+
+void perfSetMhz(uint32_t mhz) {
+  g_perfMhz.store(mhz);
+}
+
+// Slot for a route, PERF_COUNT (not recorded) once all are taken
+uint8_t perfApiSlot(const char* method, const char* uri) {
+  if (g_perfApiCount >= PERF_API_SLOTS) return PERF_COUNT;
+  snprintf(g_perfApiNames[g_perfApiCount], sizeof(g_perfApiNames[0]), "%s %s", method, uri);
+  return PERF_API + g_perfApiCount++;
+}
+
+const char* perfName(uint8_t id) {
+  return id < PERF_API ? PERF_NAMES[id] : g_perfApiNames[id - PERF_API];
+}
+
+void perfReset() {
+  portENTER_CRITICAL(&g_perfMux);
+  memset(g_perf, 0, sizeof(g_perf));
+  portEXIT_CRITICAL(&g_perfMux);
+}
+
+// p99 is the upper edge of its bin (<= +41%), capped at max
+bool perfSummary(uint8_t id, PerfSummary& out) {
+  PerfStat st;
+  portENTER_CRITICAL(&g_perfMux);
+  st = g_perf[id];
+  portEXIT_CRITICAL(&g_perfMux);
+  if (st.count == 0) return false;
+
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < PERF_BINS; i++) total += st.bins[i];
+  uint32_t tail = total / 100, seen = 0;
+  uint8_t b = PERF_BINS - 1;
+  for (; b > 0; b--) {
+    seen += st.bins[b];
+    if (seen > tail) break;
+  }
+  out.count = st.count;
+  out.minNs = st.minNs;
+  out.avgNs = (uint32_t)(st.sumNs / st.count);
+  out.p99Ns = min(perfBinTop(b), st.maxNs);
+  out.maxNs = st.maxNs;
+  return true;
+}
@@ -0,0 +1,51 @@
+#ifndef PERF_H
+#define PERF_H
+
+// Boot breakdown and hot-path timing, both reported by /api/diag.
+
+#include <Arduino.h>
+
+// Boot stages run on different tasks; each writes only its own slot.
+enum BootStageId : uint8_t {
+  BOOT_LOG, BOOT_PINS, BOOT_SETTINGS, BOOT_SENSORS, BOOT_WIFI, BOOT_HTTP,
+  BOOT_FS, BOOT_RECIPES, BOOT_DFPLAYER, BOOT_STAGE_COUNT
+};
+
+struct BootStage {
+  uint32_t startUs;  // since reset (esp_timer)
+  uint32_t durUs;
+  bool done;
+};
+
+extern const char* const BOOT_STAGE_NAMES[BOOT_STAGE_COUNT];
+extern BootStage g_boot[BOOT_STAGE_COUNT];
+extern uint32_t g_bootReadyUs; // portal served from here on
+
+void bootBegin(BootStageId id);
+void bootEnd(BootStageId id);
+bool bootAllDone();
+
+// One slot per instrumented call; API handlers get a slot each as routes are
+// registered (httpOn).
+static const uint8_t PERF_API_SLOTS = 32;
+static const uint8_t PERF_BINS = 40; // two per octave from 256ns, last = overflow
+
+enum PerfId : uint8_t {
+  PERF_LOOP, PERF_DNS, PERF_HTTP, PERF_FSM, PERF_CUP, PERF_LIMITS, PERF_TEMP,
+  PERF_API, PERF_COUNT = PERF_API + PERF_API_SLOTS
+};
+
+struct PerfSummary {
+  uint32_t count;
+  uint32_t minNs, avgNs, p99Ns, maxNs;
+};
+
+static inline uint32_t perfStart() { return ESP.getCycleCount(); }
+void perfEnd(uint8_t id, uint32_t startCycles);
+void perfSetMhz(uint32_t mhz); // cycle counts follow the CPU clock
+uint8_t perfApiSlot(const char* method, const char* uri); // PERF_COUNT once all are taken
+const char* perfName(uint8_t id);
+void perfReset();
+bool perfSummary(uint8_t id, PerfSummary& out); // false if the slot never ran
+
+#endif
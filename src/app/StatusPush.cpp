@@ -0,0 +1,213 @@
+#include "StatusPush.h"
+#include "../core/Logger.h"
+#include "Api.h"
+#include "Machine.h"
+
+static const float SSE_TEMP_DEADBAND_C = 0.5f;
+
+static bool g_sseLastCup = false;
+static float g_sseLastTemp = NAN;
+static const char* g_sseLastStep = nullptr; // step/error are literals: compared by pointer
+static const char* g_sseLastError = nullptr;
+
+uint32_t g_statusSeq = 1;
+
+size_t sseBuildStatusJson(char* buf, size_t cap) {
+  StaticJsonDocument<512> d;
+  fillStatusJson(d);
+  return serializeJson(d, buf, cap);
+}
+
+#if USE_ASYNC_HTTP
+
+int sseClientCount() { return (int)events.count(); }
+
+static void sseBroadcastStatus(const char* json) { events.send(json, "status", millis()); }
+
+static void sseKeepAlive() {}
+
+#else
+
+static const int SSE_MAX_CLIENTS = 4;
+static const uint32_t SSE_KEEPALIVE_MS = 15000;
+
+static WiFiClient g_sseClients[SSE_MAX_CLIENTS];
+static uint32_t g_sseLastWriteMs = 0;
+
+int sseClientCount() {
+  int n = 0;
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (g_sseClients[i] && g_sseClients[i].connected()) n++;
+  }
+  return n;
+}
+
+// Writes to every subscriber; a client that cannot take the whole frame is dropped.
+static void sseBroadcast(const char* frame, size_t len) {
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    WiFiClient& c = g_sseClients[i];
+    if (!c) continue;
+    if (!c.connected() || c.write((const uint8_t*)frame, len) != len) {
+      c.stop();
+      c = WiFiClient();
+      LOG_INFO("API", String("SSE client dropped | slot=") + i);
+    }
+  }
+  g_sseLastWriteMs = millis();
+}
+
+static size_t sseFrame(char* buf, size_t cap, const char* json) {
+  return snprintf(buf, cap, "event: status\ndata: %s\n\n", json);
+}
+
+static void sseBroadcastStatus(const char* json) {
+  char frame[SSE_JSON_MAX + 32];
+  sseBroadcast(frame, sseFrame(frame, sizeof(frame), json));
+}
+
+static void sseKeepAlive() {
+  if (millis() - g_sseLastWriteMs < SSE_KEEPALIVE_MS) return;
+  static const char PING[] = ": ping\n\n";
+  sseBroadcast(PING, sizeof(PING) - 1);
+}
+
+void apiEvents() {
+  int slot = -1;
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (!g_sseClients[i] || !g_sseClients[i].connected()) { slot = i; break; }
+  }
+  if (slot < 0) {
+    sendJsonError("TOO_MANY_CLIENTS");
+    return;
+  }
+
+  WiFiClient c = server.client();
+  c.print("HTTP/1.1 200 OK\r\n"
+          "Content-Type: text/event-stream\r\n"
+          "Cache-Control: no-cache\r\n"
+          "Connection: keep-alive\r\n\r\n"
+          "retry: 3000\n\n");
+
+  char json[SSE_JSON_MAX];
+  char frame[SSE_JSON_MAX + 32];
+  sseBuildStatusJson(json, sizeof(json));
+  c.write((const uint8_t*)frame, sseFrame(frame, sizeof(frame), json));
+
+  g_sseClients[slot] = c;
+  LOG_INFO("API", String("GET /api/events | slot=") + slot + " clients=" + sseClientCount());
+}
+
+#endif
+
+// Returns true (and bumps g_statusSeq) if the status changed since last call.
+static bool statusTrackChanges() {
+  SensorSnapshot snap;
+  g_sensors.read(snap);
+
+  bool tempChanged;
+  if (isnan(snap.intTemp) || isnan(g_sseLastTemp)) tempChanged = isnan(snap.intTemp) != isnan(g_sseLastTemp);
+  else tempChanged = fabsf(snap.intTemp - g_sseLastTemp) >= SSE_TEMP_DEADBAND_C;
+
+  // step and error are string literals: a pointer compare is enough
+  bool changed = g_statusDirty || tempChanged ||
+                 snap.cupPresent != g_sseLastCup ||
+                 g_machine.getStep() != g_sseLastStep ||
+                 g_machine.getError() != g_sseLastError;
+
+  if (!changed) return false;
+
+  g_statusDirty = false;
+  g_sseLastCup = snap.cupPresent;
+  g_sseLastTemp = snap.intTemp;
+  g_sseLastStep = g_machine.getStep();
+  g_sseLastError = g_machine.getError();
+  g_statusSeq++;
+  return true;
+}
+
+void ssePump() {
+  // Tracked even with no subscribers: /api/status.bin reports g_statusSeq.
+  bool changed = statusTrackChanges();
+  if (sseClientCount() == 0) return;
+
+  if (!changed) {
+    sseKeepAlive();
+    return;
+  }
+
+  char json[SSE_JSON_MAX];
+  sseBuildStatusJson(json, sizeof(json));
+  sseBroadcastStatus(json);
+  LOG_DEBUGF("API", "SSE push | seq=%lu clients=%d", (unsigned long)g_statusSeq, sseClientCount());
+}
+
+// Fixed little-endian frame for headless monitors; no key names, no parsing.
+// The ETag is the sequence number, so a poller sending If-None-Match gets an
+// empty 304 while nothing changed. The JSON endpoint stays for the UI.
+//
+//  off size field
+//   0   1   magic 'C'
+//   1   1   version (2)
+//   2   2   frame length in bytes, including the error text
+//   4   4   seq (monotonic, see statusTrackChanges)
+//   8   4   uptime ms
+//  12   1   state (MachineState ordinal, src/core/MachineController.h)
+//  13   1   flags: b0 busy, b1 cup, b2 intTemp valid, b3 extTemp valid, b4 keep-warm
+//  14   2   intTemp, int16 0.1 C (STATUS_BIN_NO_TEMP if invalid)
+//  16   2   extTemp, int16 0.1 C
+//  18   1   tempFailCount (saturates at 255)
+//  19   1   error text length N (0 = no error)
+//  20   N   error text, ASCII, not terminated
+
+static const uint8_t STATUS_BIN_MAGIC = 'C';
+static const uint8_t STATUS_BIN_VERSION = 2; // 2: MachineController state numbers
+static const int16_t STATUS_BIN_NO_TEMP = INT16_MIN;
+static const size_t STATUS_BIN_HEADER = 20;
+static const size_t STATUS_BIN_MAX_ERROR = 43; // frame fits in 64 bytes
+
+static void putU16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void putU32(uint8_t* p, uint32_t v) { putU16(p, v); putU16(p + 2, v >> 16); }
+
+static int16_t tempToC10(float c) {
+  if (isnan(c)) return STATUS_BIN_NO_TEMP;
+  float v = c * 10.0f;
+  if (v > 32767.0f) v = 32767.0f;
+  if (v < -32767.0f) v = -32767.0f;
+  return (int16_t)lroundf(v);
+}
+
+void apiStatusBin() {
+  uint32_t seq = g_statusSeq;
+  char etag[16];
+  snprintf(etag, sizeof(etag), "\"s%lu\"", (unsigned long)seq);
+  httpSendHeader("ETag", etag);
+  httpSendHeader("Cache-Control", "no-cache");
+  if (httpHeader("If-None-Match") == etag) {
+    httpSendBuf(304, "application/octet-stream", "", 0);
+    return;
+  }
+
+  SensorSnapshot snap;
+  g_sensors.read(snap);
+  const char* err = g_machine.getError();
+  size_t errLen = strlen(err);
+  if (errLen > STATUS_BIN_MAX_ERROR) errLen = STATUS_BIN_MAX_ERROR;
+
+  uint8_t f[STATUS_BIN_HEADER + STATUS_BIN_MAX_ERROR];
+  f[0] = STATUS_BIN_MAGIC;
+  f[1] = STATUS_BIN_VERSION;
+  putU16(f + 2, STATUS_BIN_HEADER + errLen);
+  putU32(f + 4, seq);
+  putU32(f + 8, millis());
+  f[12] = (uint8_t)g_machine.currentState();
+  f[13] = (g_machine.isBusy() ? 0x01 : 0) | (snap.cupPresent ? 0x02 : 0) |
+          (!isnan(snap.intTemp) ? 0x04 : 0) | (!isnan(snap.extTemp) ? 0x08 : 0) |
+          (g_machine.isKeepingWarm() ? 0x10 : 0);
+  putU16(f + 14, (uint16_t)tempToC10(snap.intTemp));
+  putU16(f + 16, (uint16_t)tempToC10(snap.extTemp));
+  f[18] = snap.tempFailCount; // saturates in SensorTask
+  f[19] = (uint8_t)errLen;
+  if (errLen) memcpy(f + STATUS_BIN_HEADER, err, errLen);
+
+  httpSendBuf(200, "application/octet-stream", (const char*)f, STATUS_BIN_HEADER + errLen);
+}
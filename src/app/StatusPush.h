@@ -0,0 +1,29 @@
+#ifndef STATUS_PUSH_H
+#define STATUS_PUSH_H
+
+// The UI subscribes once instead of polling /api/status. A "status" event
+// (same object as /api/status data) is pushed only when the FSM state changed, the
+// step/error text or cup presence changed, or intTemp moved past the deadband.
+// Sync backend: the socket is taken over from WebServer and written directly.
+// NOTE: after the hand-off WebServer keeps its accept slot in HC_WAIT_CLOSE for
+// up to HTTP_MAX_CLOSE_WAIT; that only happens on (re)connect.
+// Async backend: AsyncEventSource owns the clients.
+// /api/status.bin is the same change tracking as a fixed binary frame.
+
+#include "Http.h"
+
+static const size_t SSE_JSON_MAX = 448;
+
+// Bumped once per observed status change (same rules as the SSE push), so
+// pollers can tell an unchanged status from a new one without diffing.
+extern uint32_t g_statusSeq;
+
+size_t sseBuildStatusJson(char* buf, size_t cap); // /api/status data object
+int sseClientCount();
+void ssePump(); // loop(), under CoreLock
+void apiStatusBin();
+#if !USE_ASYNC_HTTP
+void apiEvents(); // takes the socket over from WebServer
+#endif
+
+#endif
@@ -0,0 +1,46 @@
+#include "Storage.h"
+#include "../core/Logger.h"
+#include "Perf.h"
+#include <LittleFS.h>
+#include <atomic>
+
+Preferences prefs;
+
+// ---------- LittleFS ----------
+// Mount (and format-on-fail, which can take seconds) no longer delays the
+// portal: fsBootTask runs it on core 0 while setup() continues. Handlers run
+// under CoreLock, so nothing blocks on it: static files answer 503 until the
+// mount finished and recipes load from bootPoll() once it has.
+
+enum FsState : uint8_t { FS_PENDING, FS_MOUNTED, FS_FAILED };
+
+static std::atomic<uint8_t> g_fsState(FS_PENDING);
+
+static void fsMount() {
+  bootBegin(BOOT_FS);
+  bool ok = LittleFS.begin(true);
+  bootEnd(BOOT_FS);
+  g_fsState.store(ok ? FS_MOUNTED : FS_FAILED);
+  if (!ok) LOG_ERROR("BOOT", "LittleFS mount failed (format attempted). UI fallback will still work.");
+  else LOG_INFOF("BOOT", "LittleFS mounted | %lums", (unsigned long)(g_boot[BOOT_FS].durUs / 1000));
+}
+
+static void fsBootTask(void*) {
+  fsMount();
+  vTaskDelete(nullptr);
+}
+
+void fsStartMount() {
+  if (xTaskCreatePinnedToCore(fsBootTask, "fsmount", 4096, nullptr, 1, nullptr, 0) != pdPASS) {
+    LOG_ERROR("BOOT", "LittleFS task create failed, mounting inline");
+    fsMount();
+  }
+}
+
+bool fsReady() {
+  return g_fsState.load() == FS_MOUNTED;
+}
+
+bool fsPending() {
+  return g_fsState.load() == FS_PENDING;
+}
@@ -0,0 +1,20 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+// NVS handle shared by the consumables and order stats blobs, and the
+// LittleFS mount (UI files, recipes, order traces).
+
+#include <Preferences.h>
+
+// Settings: core SettingsManager (one CRC-checked "cfg" blob, commits
+// coalesced, legacy per-key layout migrated once). Consumables and order
+// stats keep their own blobs on this handle, same namespace; opened once in
+// setup() and left open.
+static const char* const SETTINGS_NS = "coffee";
+extern Preferences prefs;
+
+void fsStartMount();
+bool fsReady();   // True once mounted; false while the boot task still runs or if it failed
+bool fsPending(); // Mount still running
+
+#endif
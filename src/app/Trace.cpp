@@ -0,0 +1,229 @@
+#include "Trace.h"
+#include "../core/Logger.h"
+#include "Machine.h"
+#include "Storage.h"
+#include <LittleFS.h>
+
+// One telemetry point, quantised; TRACE_NAN = no reading
+struct TraceSample {
+  uint32_t ms;     // millis()
+  int16_t intQ;    // internal temp, 0.25C
+  int16_t extQ;    // external temp, 0.25C
+  int16_t cupMm;   // ultrasonic distance, mm
+  uint16_t relays; // g_relayOnMask
+  uint8_t state;   // MachineState (src/core/MachineController.h)
+};
+
+static const uint32_t TRACE_SAMPLE_IDLE_MS = 1000; // idle power mode
+static const uint8_t TRACE_TICK_MS = 10;
+static const uint8_t TRACE_FILES_MAX = 10;   // oldest order file removed first
+static const uint8_t TRACE_VERSION = 2; // 2: MachineController state numbers
+static const int16_t TRACE_NAN = INT16_MIN;
+
+static const uint8_t TRACE_F_INT = 0x01;
+static const uint8_t TRACE_F_EXT = 0x02;
+static const uint8_t TRACE_F_CUP = 0x04;
+static const uint8_t TRACE_F_RELAYS = 0x08;
+static const uint8_t TRACE_F_STATE = 0x10;
+static const uint8_t TRACE_RECORD_MAX = 1 + 5 + 3 * 3 + 3 + 1;
+
+uint8_t g_traceRam[TRACE_BLOCKS][TRACE_BLOCK_BYTES];
+static uint16_t g_traceLen[TRACE_BLOCKS];
+static uint8_t g_traceHead = 0;   // block being filled
+static TraceSample g_traceLast;   // delta base
+static bool g_traceStarted = false;
+uint16_t g_traceOrder = 0;
+static bool g_traceToFs = false;  // its file was created
+uint32_t g_traceSamples = 0;
+
+static int16_t traceQuant(float v, float perUnit) {
+  if (isnan(v)) return TRACE_NAN;
+  float q = roundf(v * perUnit);
+  if (q <= INT16_MIN) return INT16_MIN + 1;
+  if (q > INT16_MAX) return INT16_MAX;
+  return (int16_t)q;
+}
+
+static uint8_t* tracePutVar(uint8_t* p, uint32_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static uint8_t* tracePutDelta(uint8_t* p, int16_t from, int16_t to) {
+  int32_t d = (int32_t)to - from;
+  return tracePutVar(p, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31)); // zigzag
+}
+
+static uint8_t* tracePut16(uint8_t* p, uint16_t v) {
+  *p++ = (uint8_t)v;
+  *p++ = (uint8_t)(v >> 8);
+  return p;
+}
+
+void tracePath(char* out, size_t n, uint16_t id) {
+  snprintf(out, n, "%s/%u.bin", TRACE_DIR, id);
+}
+
+// No file until LittleFS is up
+bool traceFsOk() {
+  return fsReady();
+}
+
+static void traceWriteBlock(uint8_t b) {
+  if (!g_traceToFs || g_traceLen[b] == 0 || !traceFsOk()) return;
+  char path[24];
+  tracePath(path, sizeof(path), g_traceOrder);
+  File f = LittleFS.open(path, "a");
+  if (!f) return;
+  uint8_t len[2];
+  tracePut16(len, g_traceLen[b]);
+  f.write(len, 2);
+  f.write(g_traceRam[b], g_traceLen[b]);
+  f.close();
+}
+
+// Closes the current block (to the order file, if one is open) and starts the next
+static void traceSeal() {
+  if (g_traceLen[g_traceHead] == 0) return;
+  traceWriteBlock(g_traceHead);
+  g_traceHead = (g_traceHead + 1) % TRACE_BLOCKS;
+  g_traceLen[g_traceHead] = 0;
+}
+
+static void traceAppend(const TraceSample& s) {
+  uint8_t rec[TRACE_RECORD_MAX];
+  uint8_t* p = rec;
+  if (g_traceLen[g_traceHead] > 0) {
+    uint8_t mask = 0;
+    if (s.intQ != g_traceLast.intQ) mask |= TRACE_F_INT;
+    if (s.extQ != g_traceLast.extQ) mask |= TRACE_F_EXT;
+    if (s.cupMm != g_traceLast.cupMm) mask |= TRACE_F_CUP;
+    if (s.relays != g_traceLast.relays) mask |= TRACE_F_RELAYS;
+    if (s.state != g_traceLast.state) mask |= TRACE_F_STATE;
+    *p++ = mask;
+    p = tracePutVar(p, s.ms / TRACE_TICK_MS - g_traceLast.ms / TRACE_TICK_MS);
+    if (mask & TRACE_F_INT) p = tracePutDelta(p, g_traceLast.intQ, s.intQ);
+    if (mask & TRACE_F_EXT) p = tracePutDelta(p, g_traceLast.extQ, s.extQ);
+    if (mask & TRACE_F_CUP) p = tracePutDelta(p, g_traceLast.cupMm, s.cupMm);
+    if (mask & TRACE_F_RELAYS) p = tracePutVar(p, s.relays);
+    if (mask & TRACE_F_STATE) *p++ = s.state;
+    if (g_traceLen[g_traceHead] + (p - rec) > TRACE_BLOCK_BYTES) {
+      traceSeal();
+      p = rec;
+    }
+  }
+  if (p == rec) { // new block: keyframe
+    p = tracePut16(tracePut16(p, (uint16_t)s.ms), (uint16_t)(s.ms >> 16));
+    p = tracePut16(p, (uint16_t)s.intQ);
+    p = tracePut16(p, (uint16_t)s.extQ);
+    p = tracePut16(p, (uint16_t)s.cupMm);
+    p = tracePut16(p, s.relays);
+    *p++ = s.state;
+  }
+  memcpy(g_traceRam[g_traceHead] + g_traceLen[g_traceHead], rec, p - rec);
+  g_traceLen[g_traceHead] += p - rec;
+  g_traceLast = s;
+  g_traceSamples++;
+}
+
+// Order id from a trace file name ("12.bin", or "/trace/12.bin" on older cores)
+bool traceFileId(const char* name, uint16_t& id) {
+  const char* base = strrchr(name, '/');
+  base = base ? base + 1 : name;
+  char* end = nullptr;
+  unsigned long v = strtoul(base, &end, 10);
+  if (end == base || strcmp(end, ".bin") != 0 || v == 0 || v > 0xFFFF) return false;
+  id = (uint16_t)v;
+  return true;
+}
+
+// Keeps at most TRACE_FILES_MAX - 1 files before newId's is created. Ids
+// wrap, so "oldest" is the one furthest behind newId.
+static void tracePrune(uint16_t newId) {
+  for (;;) {
+    File dir = LittleFS.open(TRACE_DIR);
+    if (!dir || !dir.isDirectory()) return;
+    uint8_t count = 0;
+    uint16_t oldest = 0, oldestAge = 0;
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+      uint16_t id;
+      if (!traceFileId(f.name(), id)) continue;
+      count++;
+      uint16_t age = newId - id;
+      if (age >= oldestAge) {
+        oldestAge = age;
+        oldest = id;
+      }
+    }
+    dir.close();
+    if (count < TRACE_FILES_MAX || oldest == 0) return;
+    char path[24];
+    tracePath(path, sizeof(path), oldest);
+    if (!LittleFS.remove(path)) return;
+  }
+}
+
+static void traceBegin(uint16_t id) {
+  g_traceToFs = false;
+  if (traceFsOk()) {
+    if (!LittleFS.exists(TRACE_DIR)) LittleFS.mkdir(TRACE_DIR);
+    tracePrune(id);
+    char path[24];
+    tracePath(path, sizeof(path), id);
+    File f = LittleFS.open(path, "w");
+    if (f) {
+      uint8_t hdr[8] = {'C', 'M', 'T', 'R', TRACE_VERSION, TRACE_TICK_MS, 0, 0};
+      tracePut16(hdr + 6, TRACE_BLOCK_BYTES);
+      f.write(hdr, sizeof(hdr));
+      f.close();
+      g_traceToFs = true;
+    } else {
+      LOG_WARNF("FSM", "Trace | cannot create %s", path);
+    }
+  }
+  g_traceOrder = id;
+  traceSeal(); // pre-roll: what led up to the start
+  LOG_INFOF("FSM", "Trace | recording order %u", id);
+}
+
+static void traceEnd() {
+  traceSeal();
+  if (g_traceToFs) LOG_INFOF("FSM", "Trace | order %u saved", g_traceOrder);
+  g_traceOrder = 0;
+  g_traceToFs = false;
+}
+
+static void traceSample(uint32_t now, TraceSample& s) {
+  SensorSnapshot snap;
+  g_sensors.read(snap);
+  s.ms = now;
+  s.intQ = traceQuant(snap.intTemp, 4.0f);
+  s.extQ = traceQuant(snap.extTemp, 4.0f);
+  s.cupMm = traceQuant(snap.cupDistanceCm, 10.0f);
+  s.relays = g_relayOnMask;
+  s.state = (uint8_t)g_machine.currentState();
+}
+
+// Once per loop(): order start/end edges, then a sample if one is due
+void traceUpdate(uint32_t now) {
+  bool ordering = g_machine.isBusy() && g_machine.currentState() != AUTOTUNE;
+  if (ordering && g_machine.runningId() != g_traceOrder) {
+    if (g_traceOrder) traceEnd();
+    traceBegin(g_machine.runningId());
+  }
+
+  TraceSample s;
+  traceSample(now, s);
+  uint32_t every = g_machine.isPowerSave() ? TRACE_SAMPLE_IDLE_MS : TRACE_SAMPLE_MS;
+  bool edge = s.relays != g_traceLast.relays || s.state != g_traceLast.state;
+  if (!g_traceStarted || edge || now - g_traceLast.ms >= every) {
+    traceAppend(s);
+    g_traceStarted = true;
+  }
+
+  if (!ordering && g_traceOrder) traceEnd();
+}
@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// traceUpdate() (loop) samples temperatures, cup distance, relays and state
+// every TRACE_SAMPLE_MS and on every relay/state change into a ring of
+// TRACE_BLOCKS blocks. A block opens with a keyframe (u32 ms, i16 int, i16 ext,
+// i16 cupMm, u16 relays, u8 state; little-endian) followed by records: u8
+// field mask, uvarint ticks since the previous sample, then for each masked
+// field a zigzag-uvarint delta (relays/state: new value, uvarint/u8). A steady
+// sample is ~3 bytes. While an order runs, each sealed block is appended to
+// /trace/<id>.bin (the block before the start comes along as pre-roll).
+// File: "CMTR", u8 version, u8 tick ms, u16 block bytes, then [u16 len][block].
+// tools/trace_decode.py turns a file into CSV.
+
+#include <Arduino.h>
+
+static const uint32_t TRACE_SAMPLE_MS = 200;
+static const uint16_t TRACE_BLOCK_BYTES = 256;
+static const uint8_t TRACE_BLOCKS = 24; // 6 KB, ~10 min at 200 ms
+static const char* const TRACE_DIR = "/trace";
+
+extern uint8_t g_traceRam[TRACE_BLOCKS][TRACE_BLOCK_BYTES];
+extern uint16_t g_traceOrder;   // order being recorded, 0 = none
+extern uint32_t g_traceSamples;
+
+void traceUpdate(uint32_t now); // loop
+void tracePath(char* out, size_t n, uint16_t id);
+bool traceFsOk();
+bool traceFileId(const char* name, uint16_t& id); // "<id>.bin" -> id
+
+#endif
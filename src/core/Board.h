@@ -0,0 +1,65 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+// Board pinouts shared by both firmwares (CoffeeMachine.ino and
+// coffee-machine-esp32). Select one at compile time with -DCOFFEE_BOARD=...
+// (platformio.ini build_flags, or a #define before the first core include).
+//   COFFEE_BOARD_DEVKIT38  ESP32 DevKit 38-pin, direct wiring as in the
+//                          README pinout (default)
+//   COFFEE_BOARD_MODULAR   the original coffee-machine-esp32 wiring
+// Relays are listed by device; both firmwares index them in this order.
+#define COFFEE_BOARD_DEVKIT38 1
+#define COFFEE_BOARD_MODULAR 2
+
+#ifndef COFFEE_BOARD
+#define COFFEE_BOARD COFFEE_BOARD_DEVKIT38
+#endif
+
+#if COFFEE_BOARD == COFFEE_BOARD_DEVKIT38
+#define BOARD_NAME "devkit38"
+#define BOARD_RELAY_TANK1_SUGAR     13
+#define BOARD_RELAY_TANK2_COFFEE    14
+#define BOARD_RELAY_TANK3_NESCAFE   21
+#define BOARD_RELAY_PUMP_WATER      22
+#define BOARD_RELAY_PUMP_MILK       25
+#define BOARD_RELAY_HEATER_INTERNAL 26
+#define BOARD_RELAY_HEATER_EXTERNAL 27
+#define BOARD_RELAY_MIXER_ROTATE    12 // Strap pin
+#define BOARD_RELAY_MIXER_UP        4  // Strap pin
+#define BOARD_RELAY_MIXER_DOWN      15 // Strap pin
+#define BOARD_MAX6675_SCK    18
+#define BOARD_MAX6675_SO     19
+#define BOARD_MAX6675_CS     5
+#define BOARD_MAX6675_CS_EXT -1 // Telemetry only; -1 = not fitted
+#define BOARD_US_TRIG 2  // Strap pin
+#define BOARD_US_ECHO 34 // Input-only
+#elif COFFEE_BOARD == COFFEE_BOARD_MODULAR
+#define BOARD_NAME "modular"
+#define BOARD_RELAY_TANK1_SUGAR     2
+#define BOARD_RELAY_TANK2_COFFEE    4
+#define BOARD_RELAY_TANK3_NESCAFE   12
+#define BOARD_RELAY_PUMP_WATER      13
+#define BOARD_RELAY_PUMP_MILK       14
+#define BOARD_RELAY_HEATER_INTERNAL 15
+#define BOARD_RELAY_HEATER_EXTERNAL 23
+#define BOARD_RELAY_MIXER_ROTATE    5
+#define BOARD_RELAY_MIXER_UP        21
+#define BOARD_RELAY_MIXER_DOWN      22
+#define BOARD_MAX6675_SCK    18
+#define BOARD_MAX6675_SO     19
+#define BOARD_MAX6675_CS     25
+#define BOARD_MAX6675_CS_EXT 26
+#define BOARD_US_TRIG 27
+#define BOARD_US_ECHO 34
+#else
+#error "Unknown COFFEE_BOARD"
+#endif
+
+// Common to both boards
+#define BOARD_RELAY_ACTIVE_LOW true
+#define BOARD_LIMIT_UPPER 32 // INPUT_PULLUP
+#define BOARD_LIMIT_LOWER 33 // INPUT_PULLUP
+#define BOARD_DF_TX 17 // ESP32 TX2 -> DFPlayer RX (series 1k)
+#define BOARD_DF_RX 16 // ESP32 RX2 <- DFPlayer TX
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Controller, HAL and logger tuning. Pinout and sensor tuning are in
+// CoreConfig.h; the board is picked by COFFEE_BOARD (see Board.h)
+#include "CoreConfig.h"
+
+// MAX6675 (hardware SPI, VSPI)
+#define SPI_SCK BOARD_MAX6675_SCK
+#define SPI_MISO BOARD_MAX6675_SO
+#define CS_INTERNAL BOARD_MAX6675_CS
+#define CS_EXTERNAL BOARD_MAX6675_CS_EXT // Telemetry only, -1 = not fitted
+#define MAX6675_SPI_HOST SPI3_HOST
+#define MAX6675_SPI_HZ 1000000
+#define MAX6675_MAX_C 500 // Above: garbled frame, read as NAN
+
+// UART2 for DFPlayer
+#define DFPLAYER_TX BOARD_DF_TX
+#define DFPLAYER_RX BOARD_DF_RX
+
+// Sensors
+#define ULTRASONIC_TRIG BOARD_US_TRIG
+#define ULTRASONIC_ECHO BOARD_US_ECHO
+#define LIMIT_UPPER BOARD_LIMIT_UPPER
+#define LIMIT_LOWER BOARD_LIMIT_LOWER
+
+// Relay GPIO Mapping
+#define RELAY_TANK1_SUGAR     BOARD_RELAY_TANK1_SUGAR
+#define RELAY_TANK2_COFFEE    BOARD_RELAY_TANK2_COFFEE
+#define RELAY_TANK3_NESCAFE   BOARD_RELAY_TANK3_NESCAFE
+#define RELAY_PUMP_WATER      BOARD_RELAY_PUMP_WATER
+#define RELAY_PUMP_MILK       BOARD_RELAY_PUMP_MILK
+#define RELAY_HEATER_INTERNAL BOARD_RELAY_HEATER_INTERNAL
+#define RELAY_HEATER_EXTERNAL BOARD_RELAY_HEATER_EXTERNAL
+#define RELAY_MIXER_ROTATE    BOARD_RELAY_MIXER_ROTATE
+#define RELAY_MIXER_UP        BOARD_RELAY_MIXER_UP
+#define RELAY_MIXER_DOWN      BOARD_RELAY_MIXER_DOWN
+
+#define RELAY_ACTIVE_LOW BOARD_RELAY_ACTIVE_LOW
+
+// WiFi AP
+#define AP_SSID "CoffeeMachine"
+#define AP_PASS ""
+#define AP_CHANNEL 6
+
+// Timing
+#define API_STATUS_POLL_MS 400
+#define DEBOUNCE_READS 5
+#define DEBOUNCE_INTERVAL_MS 10
+#define LIMIT_TIMEOUT_MS 10000
+#define ULTRASONIC_TIMEOUT_US 30000
+#define ULTRASONIC_MIN_CM 1 // Valid echo range, cm
+#define ULTRASONIC_MAX_CM 400
+
+// Sensor acquisition task (loop() runs on core 1)
+#define SENSOR_TASK_CORE 0
+#define SENSOR_TASK_PRIORITY 3
+#define SENSOR_TASK_STACK 4096
+#define FSM_MAX_SLEEP_MS 1000 // Longest gap between idle update() passes
+
+// Thermoblock PID: relay ON for output% of each window (see HeaterPid.h)
+#define HEATER_PWM_WINDOW_MS 2000
+#define HEATER_PWM_MIN_MS 100
+#define PID_I_LIMIT 100.0
+#define PREHEAT_BAND_C 5.0
+#define AUTOTUNE_CYCLES 3
+#define AUTOTUNE_HYST_C 0.5
+#define AUTOTUNE_MAX_MS (15UL * 60UL * 1000UL)
+
+// Overlapped drink phases: nominal relay draw (W), capped by
+// Settings.powerBudgetW (see PhaseScheduler.h)
+#define POWER_W_TANK 20
+#define POWER_W_PUMP 40
+#define POWER_W_HEATER_INTERNAL 1300
+#define POWER_W_HEATER_EXTERNAL 150
+#define POWER_W_MIXER 25
+#define POWER_BUDGET_W_DEFAULT 1600
+
+// Keep-warm between orders; predictive preheat from the order-gap EWMA
+#define ORDER_GAP_ALPHA 0.3
+#define ORDER_GAP_MAX_MS (30UL * 60UL * 1000UL) // Longer gap = new session
+#define PREDICT_LEAD_MS 60000
+
+// Order queue: head starts once idle and a fresh cup settled
+#define ORDER_QUEUE_MAX 8
+#define QUEUE_CUP_SETTLE_MS 1500
+#define MIXER_MOVE_EST_MS 3000 // Initial guess, learned per move
+
+// Table-driven recipes (see Recipe.h); custom ones from LittleFS
+#define RECIPE_STEPS_MAX 16
+#define CUSTOM_RECIPE_MAX 4
+#define RECIPES_PATH "/recipes.json"
+
+// Idle power mode: after IDLE_POWER_AFTER_MS with nothing to do the CPU
+// drops to CPU_MHZ_IDLE and sensors slow down (see MachineController.h)
+#define IDLE_POWER_SAVE 1
+#define IDLE_POWER_AFTER_MS 60000
+#define CPU_MHZ_ACTIVE 240
+#define CPU_MHZ_IDLE 80 // Lowest clock Wi-Fi accepts; APB stays 80MHz
+
+// Settings: one NVS blob, commits coalesced (see SettingsManager.h)
+#define SETTINGS_BLOB_KEY "cfg"
+#define SETTINGS_BLOB_VERSION 1
+#define SETTINGS_COMMIT_DELAY_MS 2000
+#define SETTINGS_COMMIT_MAX_MS 10000
+
+// Log ring drained to Serial by a low-priority task (see Logger.h)
+#define LOG_RING_SIZE 64
+#define LOG_MSG_MAX 112
+#define LOG_TASK_CORE 0
+#define LOG_TASK_PRIORITY 1
+#define LOG_TASK_STACK 3072
+
+// Safety
+#define INTERNAL_HEATER_ABS_MAX 110
+#define OVERTEMP_MARGIN_C 10 // Above the setpoint (intHeaterTemp)
+#define SENSOR_FAIL_RETRIES 3
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CORE_CONFIG_H
+#define CORE_CONFIG_H
+
+#include "Board.h"
+
+// Sensor tuning shared by both firmwares, so a change lands in one place.
+// Each can be overridden with -D.
+
+// Cup filter (see CupFilter.h): fast pings in VALIDATE, while a pump runs and
+// while unsure; VALIDATE waits up to CUP_VALIDATE_WAIT_MS for a settled window
+#ifndef CUP_DETECT_THRESHOLD_CM
+#define CUP_DETECT_THRESHOLD_CM 15.0 // <= threshold = cup present
+#endif
+#ifndef CUP_FILTER_LEN
+#define CUP_FILTER_LEN 5
+#endif
+#ifndef CUP_HYST_CM
+#define CUP_HYST_CM 2.0
+#endif
+#ifndef CUP_SAMPLE_MS
+#define CUP_SAMPLE_MS 200
+#endif
+#ifndef CUP_SAMPLE_FAST_MS
+#define CUP_SAMPLE_FAST_MS 60 // HC-SR04 minimum cycle
+#endif
+#ifndef CUP_SAMPLE_IDLE_MS
+#define CUP_SAMPLE_IDLE_MS 1000
+#endif
+#ifndef CUP_SETTLED_PCT
+#define CUP_SETTLED_PCT 80
+#endif
+#ifndef CUP_VALIDATE_WAIT_MS
+#define CUP_VALIDATE_WAIT_MS 500
+#endif
+
+// Sensor task period in idle power mode (the active period differs per board)
+#ifndef SENSOR_TASK_IDLE_PERIOD_MS
+#define SENSOR_TASK_IDLE_PERIOD_MS 40
+#endif
+
+// Thermocouples: read period while active and in idle power mode
+#define MAX6675_CONVERSION_MS 220
+#ifndef TEMP_SAMPLE_MS
+#define TEMP_SAMPLE_MS 250
+#endif
+#ifndef TEMP_SAMPLE_IDLE_MS
+#define TEMP_SAMPLE_IDLE_MS 1000
+#endif
+#if TEMP_SAMPLE_MS < MAX6675_CONVERSION_MS
+#error "MAX6675 needs 220ms per conversion"
+#endif
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE, reflected) of n bytes, continuing from crc (0 to start).
+// Guards the NVS blobs of both firmwares.
+uint32_t crc32Update(uint32_t crc, const uint8_t *p, size_t n);
+
+#endif
@@ -0,0 +1,44 @@
+#include "CupFilter.h"
+#include <math.h>
+
+CupFilter::CupFilter() : head(0), count(0), state(false), conf(0) {}
+
+float CupFilter::median() const {
+  float v[CUP_FILTER_LEN];
+  for (uint8_t i = 0; i < count; i++) {
+    float x = isnan(window[i]) ? INFINITY : window[i];
+    uint8_t j = i;
+    for (; j > 0 && v[j - 1] > x; j--)
+      v[j] = v[j - 1];
+    v[j] = x;
+  }
+  return v[count / 2];
+}
+
+void CupFilter::push(float cm) {
+  window[head] = cm;
+  head = (head + 1) % CUP_FILTER_LEN;
+  if (count < CUP_FILTER_LEN)
+    count++;
+
+  float med = median();
+  if (!state && med <= CUP_DETECT_THRESHOLD_CM)
+    state = true;
+  else if (state && med > CUP_DETECT_THRESHOLD_CM + CUP_HYST_CM)
+    state = false;
+
+  uint8_t agree = 0;
+  float edge = CUP_DETECT_THRESHOLD_CM + (state ? CUP_HYST_CM : 0);
+  for (uint8_t i = 0; i < count; i++) {
+    bool nearCup = !isnan(window[i]) && window[i] <= edge;
+    if (nearCup == state)
+      agree++;
+  }
+  conf = agree * 100u / count;
+}
+
+unsigned long CupFilter::sampleMs(bool fast, bool idle) const {
+  if (fast || conf < 100)
+    return CUP_SAMPLE_FAST_MS;
+  return idle ? CUP_SAMPLE_IDLE_MS : CUP_SAMPLE_MS;
+}
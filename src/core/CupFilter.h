@@ -0,0 +1,32 @@
+#ifndef CUP_FILTER_H
+#define CUP_FILTER_H
+
+#include "CoreConfig.h"
+#include <stdint.h>
+
+// Cup presence from ultrasonic pings, used by both firmwares. The state
+// follows the median of the last CUP_FILTER_LEN pings (no echo counts as far
+// away) and only drops once that median is CUP_HYST_CM past
+// CUP_DETECT_THRESHOLD_CM, so one splash or steam echo cannot abort a drink.
+class CupFilter {
+public:
+  CupFilter();
+  void push(float cm); // NAN = no echo
+  bool present() const { return state; }
+  uint8_t confidence() const { return conf; } // % of the window agreeing
+
+  // Gap before the next ping: CUP_SAMPLE_FAST_MS when asked for or while the
+  // window disagrees with the state, so a change is confirmed quickly
+  unsigned long sampleMs(bool fast, bool idle) const;
+
+private:
+  float window[CUP_FILTER_LEN];
+  uint8_t head;
+  uint8_t count;
+  bool state;
+  uint8_t conf;
+
+  float median() const;
+};
+
+#endif
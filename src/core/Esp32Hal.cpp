@@ -0,0 +1,183 @@
+#include "Esp32Hal.h"
+#include "Logger.h"
+#include <soc/gpio_reg.h>
+
+// Echo edge timestamps written by Esp32Hal::echoIsr()
+static volatile unsigned long echoRiseUs = 0;
+static volatile unsigned long echoWidthUs = 0;
+static volatile bool echoDone = false;
+
+Esp32Hal::Esp32Hal()
+    : ready(false), relayPins(0), relayShadow(0), pingActive(false),
+      pingStartUs(0), lastPingMs(0), idleRates(false), cupFast(false),
+      cupDistance(NAN) {
+  debounceHist[0] = debounceHist[1] = 0;
+  debouncePressed[0] = debouncePressed[1] = false;
+}
+
+void Esp32Hal::begin() {
+  // Init relays
+  const uint8_t pins[] = {RELAY_TANK1_SUGAR,     RELAY_TANK2_COFFEE,
+                          RELAY_TANK3_NESCAFE,   RELAY_PUMP_WATER,
+                          RELAY_PUMP_MILK,       RELAY_HEATER_INTERNAL,
+                          RELAY_HEATER_EXTERNAL, RELAY_MIXER_ROTATE,
+                          RELAY_MIXER_UP,        RELAY_MIXER_DOWN};
+  for (uint8_t pin : pins) {
+    relayPins |= 1ull << pin;
+  }
+  writeRelays(0, relayPins); // Off level latched before the outputs enable
+  for (uint8_t pin : pins) {
+    pinMode(pin, OUTPUT);
+  }
+  ready = true;
+
+  // Init ultrasonic
+  pinMode(ULTRASONIC_TRIG, OUTPUT);
+  pinMode(ULTRASONIC_ECHO, INPUT);
+  attachInterrupt(digitalPinToInterrupt(ULTRASONIC_ECHO), echoIsr, CHANGE);
+
+  // Init limit switches
+  pinMode(LIMIT_UPPER, INPUT_PULLUP);
+  pinMode(LIMIT_LOWER, INPUT_PULLUP);
+
+  thermocouples.begin();
+
+  LOG_INFO("HAL", "Sensors initialized");
+}
+
+static void setPins(uint64_t pins, bool high) {
+  uint32_t lo = (uint32_t)pins, hi = (uint32_t)(pins >> 32);
+  if (lo)
+    REG_WRITE(high ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, lo);
+  if (hi)
+    REG_WRITE(high ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, hi);
+}
+
+// Offs first, so a mixer up/down swap never overlaps
+void Esp32Hal::writeRelays(uint64_t onPins, uint64_t offPins) {
+  if (offPins)
+    setPins(offPins, RELAY_ACTIVE_LOW);
+  if (onPins)
+    setPins(onPins, !RELAY_ACTIVE_LOW);
+  relayShadow = (relayShadow | onPins) & ~offPins;
+}
+
+void Esp32Hal::relayOn(uint8_t relay) {
+  uint64_t bit = 1ull << relay;
+  if (!ready || !(relayPins & bit) || (relayShadow & bit))
+    return;
+  writeRelays(bit, 0);
+}
+
+void Esp32Hal::relayOff(uint8_t relay) {
+  uint64_t bit = 1ull << relay;
+  if (!ready || !(relayPins & bit) || !(relayShadow & bit))
+    return;
+  writeRelays(0, bit);
+}
+
+// One store per GPIO bank for all ten: the e-stop path of safeStop()/setError()
+void Esp32Hal::allRelaysOff() {
+  if (!ready)
+    return;
+  writeRelays(0, relayPins);
+}
+
+void IRAM_ATTR Esp32Hal::echoIsr() {
+  unsigned long t = micros();
+  if (digitalRead(ULTRASONIC_ECHO) == HIGH) {
+    echoRiseUs = t;
+  } else if (echoRiseUs != 0 && !echoDone) {
+    echoWidthUs = t - echoRiseUs;
+    echoDone = true;
+  }
+}
+
+void Esp32Hal::startPing() {
+  echoDone = false;
+  echoRiseUs = 0;
+
+  digitalWrite(ULTRASONIC_TRIG, LOW);
+  delayMicroseconds(2);
+  digitalWrite(ULTRASONIC_TRIG, HIGH);
+  delayMicroseconds(10);
+  digitalWrite(ULTRASONIC_TRIG, LOW);
+
+  pingStartUs = micros();
+  pingActive = true;
+}
+
+bool Esp32Hal::pollPing(float &cmOut) {
+  if (!pingActive)
+    return false;
+
+  if (echoDone) {
+    pingActive = false;
+    cmOut = (echoWidthUs * 0.034) / 2.0;
+    return true;
+  }
+
+  if (micros() - pingStartUs > 2 * ULTRASONIC_TIMEOUT_US) {
+    pingActive = false;
+    cmOut = NAN;
+    return true;
+  }
+  return false;
+}
+
+bool Esp32Hal::cupPresent() {
+  float distance;
+  if (pollPing(distance)) {
+    // Outside the HC-SR04 range is no echo, not a cup
+    cupDistance = distance >= ULTRASONIC_MIN_CM && distance <= ULTRASONIC_MAX_CM
+                      ? distance
+                      : NAN;
+    cupFilter.push(cupDistance);
+  }
+
+  if (!pingActive &&
+      millis() - lastPingMs >= cupFilter.sampleMs(cupFast, idleRates)) {
+    lastPingMs = millis();
+    startPing();
+  }
+
+  return cupFilter.present();
+}
+
+void Esp32Hal::pollThermocouples() { thermocouples.poll(); }
+
+void Esp32Hal::setIdleRates(bool idle) {
+  idleRates = idle;
+  thermocouples.setInterval(idle ? TEMP_SAMPLE_IDLE_MS : TEMP_SAMPLE_MS);
+}
+
+float Esp32Hal::readInternalTemp() {
+  return thermocouples.celsius(Max6675Bus::INTERNAL_TC);
+}
+
+float Esp32Hal::readExternalTemp() {
+  return thermocouples.celsius(Max6675Bus::EXTERNAL_TC);
+}
+
+unsigned long Esp32Hal::tempSampleMs() const {
+  return thermocouples.sampleMs(Max6675Bus::INTERNAL_TC);
+}
+
+// Changes only after DEBOUNCE_READS equal reads; holds the last stable
+// state while the contact bounces
+bool Esp32Hal::debounceRead(uint8_t pin) {
+  const uint8_t all = (1u << DEBOUNCE_READS) - 1;
+  uint8_t idx = (pin == LIMIT_UPPER) ? 0 : 1;
+  uint8_t pressed = digitalRead(pin) == LOW ? 1 : 0;
+
+  debounceHist[idx] = ((debounceHist[idx] << 1) | pressed) & all;
+  if (debounceHist[idx] == all)
+    debouncePressed[idx] = true;
+  else if (debounceHist[idx] == 0)
+    debouncePressed[idx] = false;
+  return debouncePressed[idx];
+}
+
+bool Esp32Hal::readLimitUpper() { return debounceRead(LIMIT_UPPER); }
+
+bool Esp32Hal::readLimitLower() { return debounceRead(LIMIT_LOWER); }
@@ -0,0 +1,61 @@
+#ifndef ESP32_HAL_H
+#define ESP32_HAL_H
+
+#include "CupFilter.h"
+#include "HAL.h"
+#include "Max6675Bus.h"
+
+class Esp32Hal : public HAL {
+public:
+  Esp32Hal();
+  void begin() override;
+
+  // Relay control (GPIO)
+  void relayOn(uint8_t relay) override;
+  void relayOff(uint8_t relay) override;
+  void allRelaysOff() override;
+
+  // Sensors
+  bool cupPresent() override; // Filtered pings, next one fired when due
+  float cupDistanceCm() const override { return cupDistance; }
+  uint8_t cupConfidence() const override { return cupFilter.confidence(); }
+  void setCupFast(bool fast) override { cupFast = fast; }
+  void pollThermocouples() override; // Queue/collect SPI reads
+  float readInternalTemp() override; // Cached, refreshed by pollThermocouples()
+  float readExternalTemp() override; // Telemetry only
+  unsigned long tempSampleMs() const override;
+  bool readLimitUpper() override;
+  bool readLimitLower() override;
+  void setIdleRates(bool idle) override;
+
+  bool isReady() override { return ready; }
+
+private:
+  bool ready;
+
+  // Relay bank: RELAY_* pins by GPIO bit, switched with set/clear stores
+  void writeRelays(uint64_t onPins, uint64_t offPins);
+  uint64_t relayPins;   // All ten
+  uint64_t relayShadow; // Energized
+
+  Max6675Bus thermocouples;
+
+  // Ultrasonic (echo timed by ISR)
+  static void echoIsr();
+  void startPing();
+  bool pollPing(float &cmOut);
+  bool pingActive;
+  unsigned long pingStartUs;
+  unsigned long lastPingMs;
+  bool idleRates;
+  bool cupFast;
+  float cupDistance;
+  CupFilter cupFilter;
+
+  // Debounce: last DEBOUNCE_READS reads per switch, active low
+  bool debounceRead(uint8_t pin);
+  uint8_t debounceHist[2]; // Upper, Lower; bit set = pressed
+  bool debouncePressed[2];
+};
+
+#endif
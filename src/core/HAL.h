@@ -0,0 +1,37 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include "Config.h"
+#include <stdint.h>
+
+// Everything SensorTask and MachineController touch on the machine. Esp32Hal
+// drives the real GPIO/SPI; sim/SimHal models the machine for the native
+// benchmark (platformio.ini env:native). All calls come from one task at a
+// time: relays from the FSM, sensors from SensorTask.
+class HAL {
+public:
+  virtual ~HAL() {}
+  virtual void begin() = 0;
+
+  // Relay control
+  virtual void relayOn(uint8_t relay) = 0;
+  virtual void relayOff(uint8_t relay) = 0;
+  virtual void allRelaysOff() = 0;
+
+  // Sensors
+  virtual bool cupPresent() = 0; // Non-blocking, filtered (CupFilter)
+  virtual float cupDistanceCm() const = 0; // Last ping, unfiltered
+  virtual uint8_t cupConfidence() const = 0;
+  virtual void setCupFast(bool fast) = 0; // CUP_SAMPLE_FAST_MS pings
+  virtual void pollThermocouples() = 0; // Queue/collect reads, never blocks
+  virtual float readInternalTemp() = 0; // Cached by pollThermocouples()
+  virtual float readExternalTemp() = 0; // Telemetry only
+  virtual unsigned long tempSampleMs() const = 0;
+  virtual bool readLimitUpper() = 0;
+  virtual bool readLimitLower() = 0;
+  virtual void setIdleRates(bool idle) = 0; // *_IDLE_MS sampling
+
+  virtual bool isReady() = 0;
+};
+
+#endif
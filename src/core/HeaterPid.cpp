@@ -0,0 +1,135 @@
+#include "HeaterPid.h"
+
+static float clampf(float v, float lo, float hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+HeaterPid::HeaterPid()
+    : kp(8.0), ki(0.2), kd(20.0), ff(35.0), integral(0), out(0), lastTemp(NAN),
+      lastSampleMs(0), windowStart(0), onMs(0) {}
+
+void HeaterPid::setGains(float p, float i, float d, float f) {
+  kp = p;
+  ki = i;
+  kd = d;
+  ff = f;
+}
+
+void HeaterPid::reset(unsigned long now) {
+  integral = 0;
+  out = 0;
+  lastTemp = NAN;
+  lastSampleMs = 0;
+  windowStart = now;
+}
+
+float HeaterPid::update(float setpoint, float temp, unsigned long sampleMs,
+                        bool pumping) {
+  if (sampleMs == lastSampleMs)
+    return out;
+  float dt = lastSampleMs ? (sampleMs - lastSampleMs) / 1000.0 : 0;
+  lastSampleMs = sampleMs;
+
+  if (isnan(temp)) {
+    out = 0; // No reading: heater off until recovery or SENSOR_FAIL
+    return out;
+  }
+
+  float e = setpoint - temp;
+  float f = pumping ? ff : 0;
+  float p = kp * e;
+  float d = (dt > 0 && !isnan(lastTemp)) ? kd * (temp - lastTemp) / dt : 0;
+  lastTemp = temp;
+
+  float u = f + p + integral - d;
+  bool satHigh = u >= 100 && e > 0;
+  bool satLow = u <= 0 && e < 0;
+  if (dt > 0 && !satHigh && !satLow) {
+    integral = clampf(integral + ki * e * dt, -PID_I_LIMIT, PID_I_LIMIT);
+    u = f + p + integral - d;
+  }
+
+  out = clampf(u, 0, 100);
+  return out;
+}
+
+bool HeaterPid::relayOn(unsigned long now) {
+  unsigned long elapsed = now - windowStart;
+  if (elapsed >= HEATER_PWM_WINDOW_MS) {
+    windowStart = now - (elapsed % HEATER_PWM_WINDOW_MS);
+    elapsed = now - windowStart;
+  }
+  onMs = out * HEATER_PWM_WINDOW_MS / 100;
+  if (onMs < HEATER_PWM_MIN_MS)
+    onMs = 0;
+  else if (onMs > HEATER_PWM_WINDOW_MS - HEATER_PWM_MIN_MS)
+    onMs = HEATER_PWM_WINDOW_MS;
+  return elapsed < onMs;
+}
+
+unsigned long HeaterPid::nextSwitchMs(unsigned long now) const {
+  return windowStart + (now - windowStart < onMs ? onMs : HEATER_PWM_WINDOW_MS);
+}
+
+void HeaterAutoTune::begin(float sp, unsigned long now) {
+  setpoint = sp;
+  heating = true;
+  finished = false;
+  ok = false;
+  tMax = NAN;
+  tMin = NAN;
+  startMs = now;
+  lastRiseMs = 0;
+  cycles = 0;
+  sumAmp = 0;
+  sumPeriodMs = 0;
+  resKp = resKi = resKd = 0;
+}
+
+bool HeaterAutoTune::update(float temp, unsigned long now) {
+  if (finished)
+    return false;
+  if (now - startMs > AUTOTUNE_MAX_MS) {
+    finished = true; // ok stays false
+    return false;
+  }
+  if (isnan(temp))
+    return false; // Never heat blind; the caller counts failed reads
+
+  if (isnan(tMax) || temp > tMax)
+    tMax = temp;
+  if (isnan(tMin) || temp < tMin)
+    tMin = temp;
+
+  if (heating && temp > setpoint + AUTOTUNE_HYST_C) {
+    heating = false;
+  } else if (!heating && temp < setpoint - AUTOTUNE_HYST_C) {
+    // Rising switch closes a full cycle; the first one only settles
+    if (lastRiseMs != 0 && ++cycles > 1) {
+      sumAmp += (tMax - tMin) / 2;
+      sumPeriodMs += now - lastRiseMs;
+    }
+    lastRiseMs = now;
+    tMax = tMin = temp;
+    if (cycles > AUTOTUNE_CYCLES) {
+      finish();
+      return false;
+    }
+    heating = true;
+  }
+  return heating;
+}
+
+void HeaterAutoTune::finish() {
+  finished = true;
+  float a = sumAmp / AUTOTUNE_CYCLES;
+  float tu = sumPeriodMs / 1000.0 / AUTOTUNE_CYCLES;
+  if (a < 0.1 || tu <= 0)
+    return;
+
+  float ku = 4.0 * 50.0 / (PI * a);
+  resKp = 0.6 * ku;
+  resKi = 1.2 * ku / tu;
+  resKd = 0.075 * ku * tu;
+  ok = true;
+}
@@ -0,0 +1,65 @@
+#ifndef HEATER_PID_H
+#define HEATER_PID_H
+
+#include "Config.h"
+#include <Arduino.h>
+
+// Thermoblock controller: u = ff + Kp*e + I - Kd*dT/dt in % duty, evaluated
+// once per MAX6675 sample. ff is only added while a pump runs (flow
+// feed-forward). I stops integrating while u is saturated in the direction of
+// the error (anti-windup) and is clamped to +/-PID_I_LIMIT. relayOn() turns
+// the duty into time-proportioned ON/OFF over HEATER_PWM_WINDOW_MS.
+class HeaterPid {
+public:
+  HeaterPid();
+  void setGains(float kp, float ki, float kd, float ff);
+  void reset(unsigned long now);
+
+  // Returns the duty (0..100); repeated calls with the same sampleMs are no-ops
+  float update(float setpoint, float temp, unsigned long sampleMs,
+               bool pumping);
+  bool relayOn(unsigned long now);
+  // Next relay edge (or window start) after relayOn(now)
+  unsigned long nextSwitchMs(unsigned long now) const;
+  float output() const { return out; }
+
+private:
+  float kp, ki, kd, ff;
+  float integral;
+  float out;
+  float lastTemp;
+  unsigned long lastSampleMs;
+  unsigned long windowStart;
+  unsigned long onMs; // Of the current window
+};
+
+// Relay-feedback auto-tune: bang around the setpoint with +/-AUTOTUNE_HYST_C,
+// skip the first cycle, average amplitude a and period Tu over AUTOTUNE_CYCLES,
+// then Ku = 4*50/(pi*a) and Ziegler-Nichols gains.
+class HeaterAutoTune {
+public:
+  void begin(float setpoint, unsigned long now);
+  bool update(float temp, unsigned long now); // Heater relay state, off on NAN
+  bool done() const { return finished; }
+  bool failed() const { return finished && !ok; }
+  float kp() const { return resKp; }
+  float ki() const { return resKi; }
+  float kd() const { return resKd; }
+
+private:
+  float setpoint;
+  bool heating;
+  bool finished;
+  bool ok;
+  float tMax, tMin;
+  unsigned long startMs;
+  unsigned long lastRiseMs;
+  int cycles;
+  float sumAmp;
+  unsigned long sumPeriodMs;
+  float resKp, resKi, resKd;
+
+  void finish();
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "Logger.h"
+#include <stdarg.h>
+
+const char *const LOG_LEVEL_NAMES[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+struct ModuleLevel {
+  const char *module;
+  uint8_t level;
+};
+
+static const int MAX_MODULE_LEVELS = 12;
+
+static LogEntry ring[LOG_RING_SIZE];
+static uint32_t headSeq = 0; // Newest entry; 0 = none yet
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t task = nullptr;
+
+static uint8_t defaultLevel = LOG_LEVEL_INFO;
+static ModuleLevel overrides[MAX_MODULE_LEVELS];
+static int overrideCount = 0;
+
+static uint32_t oldestFor(uint32_t head) {
+  return head >= LOG_RING_SIZE ? head - LOG_RING_SIZE + 1 : 1;
+}
+
+static void drainTask(void *) {
+  uint32_t next = 1;
+  LogEntry e;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    uint32_t head = logHeadSeq();
+    uint32_t oldest = oldestFor(head);
+    if (next < oldest) {
+      Serial.printf("[%lu][WARN][LOG] %lu lines dropped\n", millis(),
+                    (unsigned long)(oldest - next));
+      next = oldest;
+    }
+    for (; next <= head; next++) {
+      if (!logRead(next, e))
+        continue; // Lapped while printing
+      Serial.printf("[%lu][%s][%s] %s\n", (unsigned long)e.ms,
+                    LOG_LEVEL_NAMES[e.level], e.module, e.msg);
+    }
+  }
+}
+
+void logBegin() {
+  xTaskCreatePinnedToCore(drainTask, "log", LOG_TASK_STACK, nullptr,
+                          LOG_TASK_PRIORITY, &task, LOG_TASK_CORE);
+}
+
+uint8_t logLevel(const char *module) {
+  for (int i = 0; i < overrideCount; i++) {
+    if (strcmp(overrides[i].module, module) == 0)
+      return overrides[i].level;
+  }
+  return defaultLevel;
+}
+
+bool logSetLevel(const char *module, uint8_t level) {
+  if (level > LOG_LEVEL_DEBUG)
+    return false;
+  if (strcmp(module, "*") == 0) {
+    defaultLevel = level;
+    overrideCount = 0;
+    return true;
+  }
+  for (int i = 0; i < overrideCount; i++) {
+    if (strcmp(overrides[i].module, module) == 0) {
+      overrides[i].level = level;
+      return true;
+    }
+  }
+  if (overrideCount >= MAX_MODULE_LEVELS)
+    return false;
+  // Callers pass literals (same as LOG_*), so the pointer stays valid
+  overrides[overrideCount].module = module;
+  overrides[overrideCount].level = level;
+  overrideCount++;
+  return true;
+}
+
+void logWrite(uint8_t level, const char *module, const char *fmt, ...) {
+  if (level > logLevel(module))
+    return;
+
+  char msg[LOG_MSG_MAX];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+
+  uint32_t ms = millis();
+  portENTER_CRITICAL(&mux);
+  uint32_t seq = ++headSeq;
+  LogEntry &e = ring[seq % LOG_RING_SIZE];
+  e.seq = seq;
+  e.ms = ms;
+  e.level = level;
+  e.module = module;
+  memcpy(e.msg, msg, sizeof(msg));
+  portEXIT_CRITICAL(&mux);
+
+  if (task)
+    xTaskNotifyGive(task);
+}
+
+uint32_t logHeadSeq() {
+  portENTER_CRITICAL(&mux);
+  uint32_t head = headSeq;
+  portEXIT_CRITICAL(&mux);
+  return head;
+}
+
+uint32_t logOldestSeq() { return oldestFor(logHeadSeq()); }
+
+bool logRead(uint32_t seq, LogEntry &out) {
+  portENTER_CRITICAL(&mux);
+  bool ok = seq != 0 && seq <= headSeq && headSeq - seq < LOG_RING_SIZE;
+  if (ok)
+    out = ring[seq % LOG_RING_SIZE];
+  portEXIT_CRITICAL(&mux);
+  return ok;
+}
@@ -0,0 +1,73 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "Config.h"
+#include <Arduino.h>
+
+// LOG_*() format into a RAM ring and return; a low-priority task (logBegin)
+// prints "[ms][LEVEL][MODULE] msg" to Serial. logRead() serves the same
+// entries to the web layer. DEBUG is stripped unless LOG_COMPILE_LEVEL is
+// raised (e.g. build_flags = -DLOG_COMPILE_LEVEL=3).
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+struct LogEntry {
+  uint32_t seq;       // Monotonic, 1-based
+  uint32_t ms;        // millis() when logged
+  uint8_t level;      // LOG_LEVEL_*
+  const char *module; // String literal passed to LOG_*()
+  char msg[LOG_MSG_MAX];
+};
+
+extern const char *const LOG_LEVEL_NAMES[];
+
+void logBegin();
+void logWrite(uint8_t level, const char *module, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Runtime threshold per module; "*" sets the default and clears overrides.
+bool logSetLevel(const char *module, uint8_t level);
+uint8_t logLevel(const char *module);
+
+uint32_t logHeadSeq();
+uint32_t logOldestSeq();
+bool logRead(uint32_t seq, LogEntry &out); // False if not yet written or lapped
+
+inline const char *logStr(const char *s) { return s; }
+inline const char *logStr(const String &s) { return s.c_str(); }
+
+#define LOG_INFO(module, msg) logWrite(LOG_LEVEL_INFO, module, "%s", logStr(msg))
+#define LOG_WARN(module, msg) logWrite(LOG_LEVEL_WARN, module, "%s", logStr(msg))
+#define LOG_ERROR(module, msg)                                                 \
+  logWrite(LOG_LEVEL_ERROR, module, "%s", logStr(msg))
+
+// printf-style variants; fmt must be a string literal
+#define LOG_INFOF(module, fmt, ...)                                            \
+  logWrite(LOG_LEVEL_INFO, module, fmt, ##__VA_ARGS__)
+#define LOG_WARNF(module, fmt, ...)                                            \
+  logWrite(LOG_LEVEL_WARN, module, fmt, ##__VA_ARGS__)
+#define LOG_ERRORF(module, fmt, ...)                                           \
+  logWrite(LOG_LEVEL_ERROR, module, fmt, ##__VA_ARGS__)
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(module, msg)                                                 \
+  logWrite(LOG_LEVEL_DEBUG, module, "%s", logStr(msg))
+#define LOG_DEBUGF(module, fmt, ...)                                           \
+  logWrite(LOG_LEVEL_DEBUG, module, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(module, msg)                                                 \
+  do {                                                                         \
+  } while (0)
+#define LOG_DEBUGF(module, fmt, ...)                                           \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#endif
@@ -0,0 +1,1137 @@
+#include "MachineController.h"
+#include "Logger.h"
+
+static const char *const STATE_NAMES[] = {"IDLE",
+                                          "VALIDATE",
+                                          "DISPENSE_SOLIDS",
+                                          "HEAT_INTERNAL_PREHEAT",
+                                          "HEAT_INTERNAL_ACTIVE",
+                                          "HEAT_EXTERNAL",
+                                          "DISPENSE_LIQUID",
+                                          "MIX_DOWN",
+                                          "MIX_RUN",
+                                          "MIX_UP",
+                                          "DONE",
+                                          "ERROR",
+                                          "SAFE_STOP",
+                                          "AUTOTUNE"};
+static_assert(sizeof(STATE_NAMES) / sizeof(STATE_NAMES[0]) == AUTOTUNE + 1,
+              "STATE_NAMES out of sync with MachineState");
+
+// Phase graph (see PhaseScheduler.h). Sugar/solids gate every liquid; the
+// mixer homes meanwhile and is lowered while the liquid still pours, and the
+// cup warmer runs alongside the Coffee liquid and mixing.
+#define PH_BIT(p) (1u << (p))
+static const uint16_t SOLIDS_DONE = PH_BIT(PH_SUGAR) | PH_BIT(PH_SOLIDS);
+static const uint16_t ANY_LIQUID = PH_BIT(PH_COFFEE_LIQUID) |
+                                   PH_BIT(PH_HOT_LIQUID) |
+                                   PH_BIT(PH_NESCAFE_LIQUID);
+
+static const PhaseSpec PHASE_SPECS[PH_COUNT] = {
+    {"PREHEAT", 0},
+    {"SUGAR", 0},
+    {"SOLIDS", 0},
+    {"HOME", 0},
+    {"CLEAN", 0},
+    {"COFFEE_LIQUID", SOLIDS_DONE},
+    {"HOT_LIQUID", SOLIDS_DONE | PH_BIT(PH_PREHEAT)},
+    {"NESCAFE_LIQUID", SOLIDS_DONE | PH_BIT(PH_PREHEAT)},
+    {"EXT_WARM", SOLIDS_DONE},
+    {"MIX_DOWN", SOLIDS_DONE | PH_BIT(PH_HOME)},
+    {"MIX_RUN", PH_BIT(PH_MIX_DOWN) | ANY_LIQUID},
+    {"MIX_UP", PH_BIT(PH_MIX_RUN)}};
+
+static const MachineState PHASE_STATES[PH_COUNT] = {
+    HEAT_INTERNAL_PREHEAT, DISPENSE_SOLIDS,      DISPENSE_SOLIDS,
+    MIX_UP,                DISPENSE_LIQUID,      DISPENSE_LIQUID,
+    HEAT_INTERNAL_ACTIVE,  HEAT_INTERNAL_ACTIVE, HEAT_EXTERNAL,
+    MIX_DOWN,              MIX_RUN,              MIX_UP};
+
+static const char *const PHASE_STEPS[PH_COUNT] = {
+    "Preheating",         "Dispensing sugar",    "Dispensing solids",
+    "Mixer homing",       "Cleaning",            "Dispensing liquid",
+    "Heating and pumping", "Heating and pumping", "Cup warming",
+    "Mixer moving down",  "Mixing",              "Mixer moving up"};
+
+// Built-in recipes, index = DrinkMode - 1. Relays are RELAY_* pins; the
+// heater entry only reserves its watts, the PID switches it.
+// clang-format off
+static const RecipeStep COFFEE_STEPS[] = {
+    {PH_SUGAR, RELAY_TANK1_SUGAR, TIME_TANK1, SCALE_SUGAR, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_SOLIDS, RELAY_TANK2_COFFEE, TIME_TANK2, SCALE_SIZE, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_HOME, RELAY_MIXER_UP, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_UPPER, 0, 0},
+    {PH_COFFEE_LIQUID, RELAY_PUMP_WATER, TIME_WATER, SCALE_SIZE, GUARD_BREW_WATER, END_TIMER, 0, 0},
+    {PH_COFFEE_LIQUID, RELAY_PUMP_MILK, TIME_MILK, SCALE_SIZE, GUARD_BREW_MILK, END_TIMER, 0, 0},
+    {PH_EXT_WARM, RELAY_HEATER_EXTERNAL, TIME_EXT_HEATER, SCALE_ONE, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_MIX_DOWN, RELAY_MIXER_DOWN, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_LOWER, 0, 0},
+    {PH_MIX_RUN, RELAY_MIXER_ROTATE, TIME_MIXER, SCALE_ONE, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_MIX_UP, RELAY_MIXER_UP, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_UPPER, 0, 0}};
+
+// Exclusive water OR milk, milk extra is 2x
+static const RecipeStep HOTWATER_STEPS[] = {
+    {PH_PREHEAT, RELAY_HEATER_INTERNAL, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_PREHEAT, 0, 0},
+    {PH_SUGAR, RELAY_TANK1_SUGAR, TIME_TANK1, SCALE_SUGAR, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_HOME, RELAY_MIXER_UP, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_UPPER, 0, 0},
+    {PH_HOT_LIQUID, RELAY_PUMP_WATER, TIME_WATER, SCALE_SIZE, GUARD_HOT_WATER, END_TIMER, STEP_HEATED, 0},
+    {PH_HOT_LIQUID, RELAY_PUMP_MILK, TIME_MILK, SCALE_HOT_MILK, GUARD_HOT_MILK, END_TIMER, STEP_HEATED, 0},
+    {PH_MIX_DOWN, RELAY_MIXER_DOWN, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_LOWER, 0, 0},
+    {PH_MIX_RUN, RELAY_MIXER_ROTATE, TIME_MIXER, SCALE_ONE, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_MIX_UP, RELAY_MIXER_UP, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_UPPER, 0, 0}};
+
+// Water portion, then the milk portion of the ratio
+static const RecipeStep NESCAFE_STEPS[] = {
+    {PH_PREHEAT, RELAY_HEATER_INTERNAL, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_PREHEAT, 0, 0},
+    {PH_SUGAR, RELAY_TANK1_SUGAR, TIME_TANK1, SCALE_SUGAR, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_SOLIDS, RELAY_TANK3_NESCAFE, TIME_TANK3, SCALE_SIZE, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_HOME, RELAY_MIXER_UP, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_UPPER, 0, 0},
+    {PH_NESCAFE_LIQUID, RELAY_PUMP_WATER, TIME_WATER, SCALE_NES_WATER, GUARD_ALWAYS, END_TIMER, STEP_HEATED, 0},
+    {PH_NESCAFE_LIQUID, RELAY_PUMP_MILK, TIME_MILK, SCALE_NES_MILK, GUARD_ALWAYS, END_TIMER, STEP_HEATED | STEP_AFTER_PREV, 0},
+    {PH_MIX_DOWN, RELAY_MIXER_DOWN, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_LOWER, 0, 0},
+    {PH_MIX_RUN, RELAY_MIXER_ROTATE, TIME_MIXER, SCALE_ONE, GUARD_ALWAYS, END_TIMER, 0, 0},
+    {PH_MIX_UP, RELAY_MIXER_UP, TIME_NONE, SCALE_ONE, GUARD_ALWAYS, END_UPPER, 0, 0}};
+
+static const RecipeStep CLEANING_STEPS[] = {
+    {PH_CLEAN, RELAY_PUMP_WATER, TIME_WATER, SCALE_ONE, GUARD_CLEAN_WATER, END_TIMER, 0, 0},
+    {PH_CLEAN, RELAY_PUMP_MILK, TIME_MILK, SCALE_ONE, GUARD_CLEAN_MILK, END_TIMER, 0, 0}};
+// clang-format on
+
+#define STEPS_OF(a) a, (uint8_t)(sizeof(a) / sizeof(a[0]))
+static const Recipe BUILTIN_RECIPES[] = {{"Coffee", STEPS_OF(COFFEE_STEPS)},
+                                         {"HotWater", STEPS_OF(HOTWATER_STEPS)},
+                                         {"Nescafe", STEPS_OF(NESCAFE_STEPS)},
+                                         {"Cleaning", STEPS_OF(CLEANING_STEPS)}};
+static_assert(sizeof(BUILTIN_RECIPES) / sizeof(BUILTIN_RECIPES[0]) ==
+                  MODE_CLEANING,
+              "BUILTIN_RECIPES out of sync with DrinkMode");
+
+static uint16_t relayWatts(uint8_t relay) {
+  switch (relay) {
+  case RELAY_HEATER_INTERNAL:
+    return POWER_W_HEATER_INTERNAL;
+  case RELAY_HEATER_EXTERNAL:
+    return POWER_W_HEATER_EXTERNAL;
+  case RELAY_PUMP_WATER:
+  case RELAY_PUMP_MILK:
+    return POWER_W_PUMP;
+  case RELAY_MIXER_ROTATE:
+  case RELAY_MIXER_UP:
+  case RELAY_MIXER_DOWN:
+    return POWER_W_MIXER;
+  default: // Tanks
+    return POWER_W_TANK;
+  }
+}
+
+static float stepBaseSec(const RecipeStep &st, const Settings &s) {
+  switch (st.time) {
+  case TIME_TANK1:
+    return s.tank1Time;
+  case TIME_TANK2:
+    return s.tank2Time;
+  case TIME_TANK3:
+    return s.tank3Time;
+  case TIME_WATER:
+    return s.waterPumpTime;
+  case TIME_MILK:
+    return s.milkPumpTime;
+  case TIME_EXT_HEATER: // Timer-only control (extHeaterTemp IGNORED)
+    return s.extHeaterTime;
+  case TIME_MIXER:
+    return s.mixerTime;
+  case TIME_FIXED:
+    return st.fixedDs / 10.0f;
+  default:
+    return 0;
+  }
+}
+
+// Nescafe ratio: none 100/0, medium 75/25, extra 50/50 (water/milk)
+static float stepScale(uint8_t scale, const OrderParams &o) {
+  float size = (o.size == SIZE_DOUBLE) ? 2 : 1;
+  float milk = o.milkRatio == RATIO_EXTRA
+                   ? 0.5f
+                   : (o.milkRatio == RATIO_MEDIUM ? 0.25f : 0);
+  switch (scale) {
+  case SCALE_SIZE:
+    return size;
+  case SCALE_SUGAR:
+    return o.sugar == SUGAR_HIGH ? 4 : (o.sugar == SUGAR_MEDIUM ? 2 : 1);
+  case SCALE_HOT_MILK:
+    return size * (o.hotLiquid == LIQUID_MILK_EXTRA ? 2 : 1);
+  case SCALE_NES_WATER:
+    return size * (1 - milk);
+  case SCALE_NES_MILK:
+    return size * milk;
+  default:
+    return 1;
+  }
+}
+
+static bool stepGuardOk(uint8_t guard, const OrderParams &o) {
+  switch (guard) {
+  case GUARD_BREW_WATER:
+    return o.brewBase == BREW_WATER;
+  case GUARD_BREW_MILK:
+    return o.brewBase == BREW_MILK;
+  case GUARD_HOT_WATER:
+    return o.hotLiquid == LIQUID_WATER;
+  case GUARD_HOT_MILK:
+    return o.hotLiquid != LIQUID_WATER;
+  case GUARD_CLEAN_WATER:
+    return o.cleanWater;
+  case GUARD_CLEAN_MILK:
+    return o.cleanMilk;
+  default:
+    return true;
+  }
+}
+
+const char *const DRINK_MODE_NAMES[] = {"",         "Coffee", "HotWater",
+                                        "Nescafe",  "Cleaning", "Custom"};
+const char *const BREW_BASE_NAMES[] = {"Water", "Milk"};
+const char *const CUP_SIZE_NAMES[] = {"Single", "Double"};
+const char *const SUGAR_LEVEL_NAMES[] = {"Low", "Medium", "High"};
+const char *const HOT_LIQUID_NAMES[] = {"water", "milk_medium", "milk_extra"};
+const char *const MILK_RATIO_NAMES[] = {"none", "medium", "extra"};
+
+int parseEnumName(const char *s, const char *const *names, int count,
+                  int fallback) {
+  if (!s)
+    return fallback;
+  for (int i = 0; i < count; i++) {
+    if (names[i][0] && strcasecmp(s, names[i]) == 0)
+      return i;
+  }
+  return fallback;
+}
+
+MachineController::MachineController(HAL &halRef, SensorTask &sensorsRef,
+                                     SettingsManager &settingsRef)
+    : hal(halRef), sensors(sensorsRef), settings(settingsRef),
+      observer(nullptr), state(IDLE) {
+  order.mode = MODE_NONE;
+  orderId = 0;
+  currentStep = "";
+  errorMsg = "";
+  stateStartTime = 0;
+  heaterStartTime = 0;
+  pipelineStartTime = 0;
+  heaterHold = false;
+  heaterPumping = false;
+  lastOrderStart = 0;
+  lastOrderDone = 0;
+  orderGapEwma = 0;
+  keepWarm = false;
+  keepWarmPredict = false;
+  heaterOn = false;
+  heaterOnSince = 0;
+  heaterMJ = 0;
+  keepWarmMJ = 0;
+  queueLen = 0;
+  nextOrderId = 1;
+  cupSwapped = true;
+  cupSince = 0;
+  preheatEstMs = 0;
+  mixerMoveEstMs = MIXER_MOVE_EST_MS;
+  planLen = 0;
+  stepRunning = 0;
+  stepDone = 0;
+  wakeAtMs = 0;
+  wakeMask = SENSOR_EV_CUP;
+  powerSave = false;
+  activeSince = 0;
+}
+
+bool MachineController::start(const OrderParams &params) {
+  return startOrder(params, takeId());
+}
+
+// Ids skip 0, which means none or rejected
+uint16_t MachineController::takeId() {
+  uint16_t id = nextOrderId++;
+  if (nextOrderId == 0)
+    nextOrderId = 1;
+  return id;
+}
+
+bool MachineController::startOrder(const OrderParams &params, uint16_t id) {
+  if (!hal.isReady()) {
+    setError("NOT_READY");
+    return false;
+  }
+
+  if (isBusy()) {
+    setError("BUSY");
+    return false;
+  }
+
+  stopKeepWarm("order");
+  unsigned long now = millis();
+  if (lastOrderStart != 0) {
+    unsigned long gap = now - lastOrderStart;
+    if (gap > ORDER_GAP_MAX_MS)
+      orderGapEwma = 0;
+    else if (orderGapEwma <= 0)
+      orderGapEwma = gap;
+    else
+      orderGapEwma += ORDER_GAP_ALPHA * (gap - orderGapEwma);
+  }
+  lastOrderStart = now;
+
+  order = params;
+  orderId = id;
+  cfg = settings.get();
+  sensors.read(sensed);
+  errorMsg = "";
+  cupSwapped = false; // The next queued order needs a fresh cup
+  planLen = order.mode == MODE_NONE ? 0 : buildPlan(order, cfg, plan);
+  stepRunning = 0;
+  stepDone = 0;
+
+  if (observer)
+    observer->onOrderStart(orderId, order);
+  setState(VALIDATE);
+  LOG_INFOF("FSM", "Start: %s (%u steps)", recipeFor(order).name, planLen);
+  return true;
+}
+
+bool MachineController::startAutoTune() {
+  if (!hal.isReady() || isBusy())
+    return false;
+
+  disarmKeepWarm("autotune");
+  cfg = settings.get();
+  sensors.read(sensed);
+  errorMsg = "";
+  hal.allRelaysOff();
+
+  autoTune.begin(cfg.intHeaterTemp, millis());
+  currentStep = "Heater auto-tune";
+  setState(AUTOTUNE);
+  return true;
+}
+
+void MachineController::runAutoTune() {
+  // No cup needed, but the thermoblock interlock stays active
+  if (!heaterSafe())
+    return;
+
+  setHeater(autoTune.update(sensed.intTemp, millis()));
+  wakeOn(SENSOR_EV_TEMP); // Bang-bang switches on samples only
+  wakeAt(stateStartTime + AUTOTUNE_MAX_MS + 1);
+
+  if (!autoTune.done())
+    return;
+  if (autoTune.failed()) {
+    setError("AUTOTUNE_FAILED");
+    return;
+  }
+
+  Settings s = settings.get();
+  s.pidKp = autoTune.kp();
+  s.pidKi = autoTune.ki();
+  s.pidKd = autoTune.kd();
+  if (!settings.save(s)) {
+    setError("AUTOTUNE_FAILED"); // Gains outside the accepted range
+    return;
+  }
+  settings.commit(); // Tuning took minutes: persist at once
+  LOG_INFOF("FSM", "Auto-tune: Kp=%.2f Ki=%.3f Kd=%.1f", s.pidKp, s.pidKi,
+            s.pidKd);
+  setHeater(false);
+  hal.allRelaysOff();
+  currentStep = "Auto-tune done";
+  setState(DONE);
+}
+
+// PID + time-proportioned relay; feed-forward only while a pump runs
+void MachineController::heaterControl(float setpoint, bool pumping) {
+  unsigned long now = millis();
+  heaterPid.update(setpoint, sensed.intTemp, sensed.tempSampleMs, pumping);
+  setHeater(heaterPid.relayOn(now));
+  wakeAt(heaterPid.nextSwitchMs(now));
+  wakeOn(SENSOR_EV_TEMP);
+}
+
+// Every thermoblock switch goes through here so its energy is counted
+void MachineController::setHeater(bool on) {
+  unsigned long now = millis();
+  if (on == heaterOn) {
+    if (on)
+      hal.relayOn(RELAY_HEATER_INTERNAL);
+    return;
+  }
+  if (on) {
+    heaterOnSince = now;
+    hal.relayOn(RELAY_HEATER_INTERNAL);
+  } else {
+    uint64_t mj = (uint64_t)POWER_W_HEATER_INTERNAL * (now - heaterOnSince);
+    heaterMJ += mj;
+    if (keepWarm)
+      keepWarmMJ += mj;
+    hal.relayOff(RELAY_HEATER_INTERNAL);
+  }
+  heaterOn = on;
+}
+
+float MachineController::heaterEnergyWh() const {
+  uint64_t mj = heaterMJ;
+  if (heaterOn)
+    mj += (uint64_t)POWER_W_HEATER_INTERNAL * (millis() - heaterOnSince);
+  return mj / 3600000.0;
+}
+
+float MachineController::keepWarmEnergyWh() const {
+  uint64_t mj = keepWarmMJ;
+  if (heaterOn && keepWarm)
+    mj += (uint64_t)POWER_W_HEATER_INTERNAL * (millis() - heaterOnSince);
+  return mj / 3600000.0;
+}
+
+// After an order, hold standbyTemp for standbyMin; when the order-gap EWMA
+// says the next order is due within PREDICT_LEAD_MS, hold inside the preheat
+// band instead so PREHEAT finishes at once. Idle only, no cup needed.
+void MachineController::runKeepWarm() {
+  if (lastOrderDone == 0)
+    return;
+
+  Settings s = settings.get();
+  unsigned long now = millis();
+  bool predict = false;
+  bool predictLater = false;
+  if (s.predictPreheat && orderGapEwma > 0) {
+    unsigned long since = now - lastOrderStart;
+    unsigned long gap = (unsigned long)orderGapEwma;
+    predictLater = since + PREDICT_LEAD_MS < gap;
+    predict = !predictLater && since <= 2 * gap;
+  }
+  bool standby = s.standbyMin > 0 &&
+                 now - lastOrderDone < (unsigned long)s.standbyMin * 60000UL;
+
+  if (!predict && !standby) {
+    if (predictLater)
+      stopKeepWarm("standby expired");
+    else
+      disarmKeepWarm("standby expired");
+    return;
+  }
+
+  sensors.read(sensed);
+  if (isnan(sensed.intTemp)) { // No failure count here: never hold blind
+    disarmKeepWarm("SENSOR_FAIL");
+    return;
+  }
+  if (sensed.intTemp > INTERNAL_HEATER_ABS_MAX ||
+      sensed.intTemp > s.intHeaterTemp + OVERTEMP_MARGIN_C) {
+    disarmKeepWarm("OVERTEMP");
+    return;
+  }
+
+  if (!keepWarm) {
+    heaterPid.setGains(s.pidKp, s.pidKi, s.pidKd, s.pidFf);
+    heaterPid.reset(now);
+    keepWarm = true;
+  }
+  if (predict != keepWarmPredict) {
+    keepWarmPredict = predict;
+    LOG_INFOF("FSM", "Keep-warm: %s (gap ~%lus)",
+              predict ? "predictive preheat" : "standby",
+              (unsigned long)(orderGapEwma / 1000));
+  }
+
+  float band = s.intHeaterTemp - PREHEAT_BAND_C / 2;
+  float sp = predict ? band : min((float)s.standbyTemp, band);
+  heaterControl(sp, false);
+}
+
+void MachineController::stopKeepWarm(const char *why) {
+  if (!keepWarm)
+    return;
+  setHeater(false);
+  keepWarm = false;
+  keepWarmPredict = false;
+  LOG_INFOF("FSM", "Keep-warm off: %s (%.2fWh so far)", why,
+            keepWarmEnergyWh());
+}
+
+void MachineController::disarmKeepWarm(const char *why) {
+  stopKeepWarm(why);
+  lastOrderDone = 0;
+}
+
+void MachineController::noteActivity() {
+  activeSince = millis();
+  if (!powerSave)
+    return;
+  setCpuFrequencyMhz(CPU_MHZ_ACTIVE);
+  sensors.setIdle(false);
+  powerSave = false;
+  LOG_INFOF("POWER", "Idle power mode off (%uMHz)", CPU_MHZ_ACTIVE);
+}
+
+void MachineController::runIdlePower() {
+  unsigned long now = millis();
+  if (!IDLE_POWER_SAVE || powerSave)
+    return;
+  if (state != IDLE || queueLen > 0 || keepWarm) {
+    activeSince = now;
+    return;
+  }
+  if (now - activeSince < IDLE_POWER_AFTER_MS) {
+    wakeAt(activeSince + IDLE_POWER_AFTER_MS);
+    return;
+  }
+  setCpuFrequencyMhz(CPU_MHZ_IDLE);
+  sensors.setIdle(true);
+  powerSave = true;
+  LOG_INFOF("POWER", "Idle power mode on (%uMHz)", CPU_MHZ_IDLE);
+}
+
+void MachineController::stop() {
+  LOG_ERROR("FSM", "Emergency stop");
+  disarmKeepWarm("stop");
+  safeStop();
+  // Leave the FSM too, or the next update() re-energises relays (PID, tuner)
+  heaterStartTime = 0;
+  errorMsg = ""; // A stop acknowledges the last error
+  currentStep = "Stopped by user";
+  setState(SAFE_STOP);
+}
+
+void MachineController::setState(MachineState newState) {
+  MachineState from = state;
+  state = newState;
+  stateStartTime = millis();
+  wakeAt(stateStartTime); // Next pass acts on the new state at once
+
+  LOG_INFOF("FSM", "State: %s", STATE_NAMES[newState]);
+  if (observer && from != newState)
+    observer->onState(from, newState);
+}
+
+void MachineController::setError(const char *error) {
+  errorMsg = error;
+  setState(ERROR_STATE);
+  safeStop();
+  LOG_ERRORF("FSM", "Error: %s", error);
+}
+
+void MachineController::safeStop() {
+  setHeater(false);
+  hal.allRelaysOff();
+  phases.reset();
+  stepRunning = 0;
+  heaterHold = false;
+  heaterPumping = false;
+  currentStep = "Stopped";
+}
+
+bool MachineController::checkCup() {
+  if (!sensed.cupPresent) {
+    if (state == IDLE || state == VALIDATE) {
+      setError("NO_CUP");
+    } else {
+      setError("NO_CUP_DURING_RUN");
+      safeStop();
+    }
+    return false;
+  }
+  return true;
+}
+
+const char *MachineController::stateName(MachineState s) {
+  return s <= AUTOTUNE ? STATE_NAMES[s] : "";
+}
+
+// Lost thermocouple (SENSOR_FAIL_RETRIES bad samples in a row) or a reading
+// above the absolute or setpoint limit: judged on every sample
+bool MachineController::heaterSafe() {
+  wakeOn(SENSOR_EV_TEMP);
+  if (sensed.tempFailCount >= SENSOR_FAIL_RETRIES) {
+    setError("SENSOR_FAIL");
+    return false;
+  }
+  if (!isnan(sensed.intTemp) &&
+      (sensed.intTemp > INTERNAL_HEATER_ABS_MAX ||
+       sensed.intTemp > cfg.intHeaterTemp + OVERTEMP_MARGIN_C)) {
+    setError("OVERTEMP");
+    return false;
+  }
+  return true;
+}
+
+const char *MachineController::phaseName(uint8_t phase) const {
+  return phase < PH_COUNT ? PHASE_SPECS[phase].name : "";
+}
+
+void MachineController::trackCup() {
+  bool had = sensed.cupPresent;
+  sensors.read(sensed);
+  if (sensed.cupPresent != had)
+    noteActivity();
+  if (!sensed.cupPresent) {
+    cupSwapped = true;
+    cupSince = 0;
+  } else if (cupSince == 0) {
+    cupSince = millis() | 1;
+  }
+}
+
+void MachineController::wakeAt(unsigned long ms) {
+  if ((long)(ms - wakeAtMs) < 0)
+    wakeAtMs = ms;
+}
+
+void MachineController::update() {
+  runPass();
+  // Cup pings for the next pass: fast while starting or pouring
+  sensors.setCupFast(state == VALIDATE || pumpRunning());
+}
+
+// A water or milk pump step is on
+bool MachineController::pumpRunning() const {
+  for (uint8_t i = 0; i < planLen; i++) {
+    if ((stepRunning & (1u << i)) && (plan[i].relay == RELAY_PUMP_WATER ||
+                                      plan[i].relay == RELAY_PUMP_MILK))
+      return true;
+  }
+  return false;
+}
+
+void MachineController::runPass() {
+  wakeAtMs = millis() + FSM_MAX_SLEEP_MS;
+  wakeMask = SENSOR_EV_CUP; // Cup interlock and queue start, always
+  trackCup();
+  if (state == DONE || state == SAFE_STOP) { // Shown for one pass
+    currentStep = "";
+    setState(IDLE);
+  }
+  // An aborted order must not strand the ones queued behind it: a fresh
+  // cup starts the next from ERROR_STATE too (start() clears the error)
+  bool queueable = state == IDLE || (state == ERROR_STATE && queueLen > 0);
+  if (queueable && !startQueued() && state == IDLE)
+    runKeepWarm();
+  runIdlePower();
+  if (state == IDLE || state == ERROR_STATE)
+    return;
+
+  if (state == AUTOTUNE) {
+    runAutoTune();
+    return;
+  }
+
+  if (state == VALIDATE) {
+    // A cup just placed (or a splash) leaves the filter unsettled: the fast
+    // pings get CUP_VALIDATE_WAIT_MS to confirm before the start is decided
+    if (sensed.cupConfidence < CUP_SETTLED_PCT &&
+        millis() - stateStartTime < CUP_VALIDATE_WAIT_MS) {
+      wakeAt(stateStartTime + CUP_VALIDATE_WAIT_MS);
+      return;
+    }
+    if (!checkCup())
+      return;
+    if (order.mode == MODE_NONE) {
+      setError("BAD_MODE");
+      return;
+    }
+    if (planLimitSteps() && sensed.limitUpper && sensed.limitLower) {
+      setError("LIMIT_INVALID");
+      return;
+    }
+    if (planLen == 0) { // e.g. Cleaning without water or milk
+      setError("BAD_PARAMS");
+      return;
+    }
+    const char *refused =
+        observer ? observer->checkPlan(plan, planLen) : nullptr;
+    if (refused) {
+      setError(refused);
+      return;
+    }
+    beginPipeline();
+  }
+
+  if (planHeats() && !heaterSafe())
+    return;
+  runPipeline();
+}
+
+const Recipe &MachineController::recipeFor(const OrderParams &o) const {
+  if (o.mode == MODE_CUSTOM && o.recipe < recipeBook.size())
+    return recipeBook.at(o.recipe);
+  if (o.mode >= MODE_COFFEE && o.mode <= MODE_CLEANING)
+    return BUILTIN_RECIPES[o.mode - MODE_COFFEE];
+  return BUILTIN_RECIPES[0];
+}
+
+bool MachineController::loadRecipes(fs::FS &fs) {
+  if (state != IDLE || queueLen > 0)
+    return false;
+  recipeBook.load(fs, RECIPES_PATH, PHASE_SPECS, PH_COUNT);
+  return true;
+}
+
+// Guards and on-times resolved once; timed steps with nothing to do dropped
+uint8_t MachineController::buildPlan(const OrderParams &o, const Settings &s,
+                                     PlannedStep *out) const {
+  const Recipe &r = recipeFor(o);
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < r.count && n < RECIPE_STEPS_MAX; i++) {
+    const RecipeStep &st = r.steps[i];
+    if (!stepGuardOk(st.guard, o))
+      continue;
+    unsigned long dur = 0;
+    if (st.end == END_TIMER) {
+      dur = (unsigned long)(stepBaseSec(st, s) * stepScale(st.scale, o) * 1000);
+      if (dur == 0)
+        continue;
+    }
+    out[n].phase = st.phase;
+    out[n].relay = st.relay;
+    out[n].end = st.end;
+    out[n].flags = st.flags;
+    out[n].durMs = dur;
+    n++;
+  }
+  return n;
+}
+
+static uint16_t planPhases(const PlannedStep *steps, uint8_t n) {
+  uint16_t need = 0;
+  for (uint8_t i = 0; i < n; i++)
+    need |= PH_BIT(steps[i].phase);
+  return need;
+}
+
+bool MachineController::planHeats() const {
+  for (uint8_t i = 0; i < planLen; i++) {
+    if (plan[i].end == END_PREHEAT || (plan[i].flags & STEP_HEATED))
+      return true;
+  }
+  return false;
+}
+
+// Steps ending on a mixer limit switch
+uint16_t MachineController::planLimitSteps() const {
+  uint16_t mask = 0;
+  for (uint8_t i = 0; i < planLen; i++) {
+    if (plan[i].end == END_UPPER || plan[i].end == END_LOWER)
+      mask |= 1u << i;
+  }
+  return mask;
+}
+
+uint16_t MachineController::phaseWatts(uint8_t phase) const {
+  uint16_t w = 0;
+  for (uint8_t i = 0; i < planLen; i++) {
+    bool dup = false; // Same relay twice (e.g. after a guard) counts once
+    for (uint8_t j = 0; j < i && !dup; j++)
+      dup = plan[j].phase == phase && plan[j].relay == plan[i].relay;
+    if (plan[i].phase == phase && !dup)
+      w += relayWatts(plan[i].relay);
+  }
+  return w;
+}
+
+void MachineController::beginPipeline() {
+  pipelineStartTime = millis();
+  heaterStartTime = 0;
+  heaterHold = false;
+  heaterPumping = false;
+  stepRunning = 0;
+  stepDone = 0;
+  phases.begin(PHASE_SPECS, PH_COUNT, planPhases(plan, planLen),
+               cfg.powerBudgetW);
+  for (uint8_t p = 0; p < PH_COUNT; p++)
+    phases.setWatts(p, phaseWatts(p));
+}
+
+void MachineController::runPipeline() {
+  if (!checkCup())
+    return;
+
+  unsigned long now = millis();
+
+  if (heaterHold) {
+    if (now - heaterStartTime > (unsigned long)cfg.intHeaterTime * 1000) {
+      setError("HEAT_TIMEOUT");
+      return;
+    }
+    wakeAt(heaterStartTime + (unsigned long)cfg.intHeaterTime * 1000 + 1);
+  }
+
+  if ((stepRunning & planLimitSteps()) && sensed.limitUpper &&
+      sensed.limitLower) {
+    setError("LIMIT_INVALID");
+    return;
+  }
+
+  for (uint8_t p = 0; p < PH_COUNT; p++) {
+    if (!phases.isRunning(p))
+      continue;
+    bool done = stepPhase(p, now);
+    if (state == ERROR_STATE)
+      return;
+    if (done)
+      phases.finish(p, now);
+  }
+
+  if (phases.allDone()) {
+    setHeater(false);
+    hal.allRelaysOff();
+    phases.reset();
+    lastOrderDone = now ? now : 1;
+    currentStep = "Cycle done";
+    setState(DONE);
+    LOG_INFOF("FSM", "%s cycle complete in %lums", recipeFor(order).name,
+              now - pipelineStartTime);
+    return;
+  }
+
+  // The heater keeps its watts after PREHEAT while the PID still holds it
+  uint16_t heldW =
+      heaterHold && !phases.isRunning(PH_PREHEAT) ? POWER_W_HEATER_INTERNAL : 0;
+  uint16_t started = phases.startReady(heldW, now);
+  for (uint8_t p = 0; p < PH_COUNT; p++) {
+    if (started & PH_BIT(p))
+      startPhase(p, now);
+  }
+
+  if (phases.running() == 0) {
+    setError("PIPELINE_STALL"); // Unreachable dependency: table bug
+    return;
+  }
+
+  if (heaterHold)
+    heaterControl(cfg.intHeaterTemp, heaterPumping);
+  armStepWakes();
+
+  showLeadingPhase();
+}
+
+// What the running steps wait for
+void MachineController::armStepWakes() {
+  for (uint8_t i = 0; i < planLen; i++) {
+    if (!(stepRunning & (1u << i)))
+      continue;
+    switch (plan[i].end) {
+    case END_TIMER:
+      wakeAt(stepStart[i] + plan[i].durMs);
+      break;
+    case END_UPPER:
+    case END_LOWER:
+      wakeOn(SENSOR_EV_LIMIT);
+      wakeAt(stepStart[i] + LIMIT_TIMEOUT_MS + 1);
+      break;
+    default:
+      wakeOn(SENSOR_EV_TEMP);
+      break;
+    }
+  }
+}
+
+void MachineController::showLeadingPhase() {
+  for (uint8_t p = 0; p < PH_COUNT; p++) {
+    if (!phases.isRunning(p))
+      continue;
+    if (currentStep != PHASE_STEPS[p] || state != PHASE_STATES[p]) {
+      currentStep = PHASE_STEPS[p];
+      setState(PHASE_STATES[p]);
+    }
+    return;
+  }
+}
+
+int MachineController::prevInPhase(uint8_t step) const {
+  for (int j = (int)step - 1; j >= 0; j--) {
+    if (plan[j].phase == plan[step].phase)
+      return j;
+  }
+  return -1;
+}
+
+// Starts the steps of a phase that do not wait for a predecessor
+void MachineController::startPhase(uint8_t phase, unsigned long now) {
+  for (uint8_t i = 0; i < planLen; i++) {
+    if (plan[i].phase != phase)
+      continue;
+    if ((plan[i].flags & STEP_AFTER_PREV) && prevInPhase(i) >= 0)
+      continue;
+    startStep(i, now);
+  }
+}
+
+bool MachineController::stepPhase(uint8_t phase, unsigned long now) {
+  bool left = false;
+  for (uint8_t i = 0; i < planLen; i++) {
+    uint16_t bit = 1u << i;
+    if (plan[i].phase != phase || (stepDone & bit))
+      continue;
+    if (!(stepRunning & bit)) {
+      int prev = prevInPhase(i);
+      if (prev >= 0 && !(stepDone & (1u << prev))) {
+        left = true;
+        continue;
+      }
+      startStep(i, now); // STEP_AFTER_PREV, predecessor just finished
+    }
+    if (!runStep(i, now)) {
+      if (state == ERROR_STATE)
+        return false;
+      left = true;
+      continue;
+    }
+    stepRunning &= ~bit;
+    stepDone |= bit;
+    if (heaterHold &&
+        (plan[i].end == END_PREHEAT || (plan[i].flags & STEP_HEATED)))
+      releaseHeaterIfDone();
+  }
+  return !left;
+}
+
+void MachineController::startStep(uint8_t i, unsigned long now) {
+  const PlannedStep &st = plan[i];
+  stepStart[i] = now;
+  stepRunning |= 1u << i;
+
+  switch (st.end) {
+  case END_PREHEAT:
+    heaterStartTime = now;
+    heaterPid.setGains(cfg.pidKp, cfg.pidKi, cfg.pidKd, cfg.pidFf);
+    heaterPid.reset(heaterStartTime);
+    preheatTarget = cfg.intHeaterTemp - PREHEAT_BAND_C;
+    heaterHold = true;
+    break;
+  case END_UPPER:
+    if (!sensed.limitUpper)
+      hal.relayOn(st.relay);
+    break;
+  case END_LOWER:
+    if (!sensed.limitLower)
+      hal.relayOn(st.relay);
+    break;
+  default:
+    hal.relayOn(st.relay);
+    LOG_INFOF("HW", "%s: relay %u ON for %lums", PHASE_SPECS[st.phase].name,
+              st.relay, st.durMs);
+    break;
+  }
+  if (st.flags & STEP_HEATED)
+    heaterPumping = true;
+}
+
+bool MachineController::runStep(uint8_t i, unsigned long now) {
+  const PlannedStep &st = plan[i];
+  unsigned long elapsed = now - stepStart[i];
+
+  switch (st.end) {
+  case END_PREHEAT: {
+    // Heater is driven by heaterControl() while heaterHold is set
+    float temp = sensed.intTemp;
+    if (isnan(temp) || temp < preheatTarget)
+      return false;
+    LOG_INFOF("FSM", "Preheat reached %.1fC in %lums", temp, elapsed);
+    preheatEstMs = preheatEstMs ? preheatEstMs + (long)(elapsed - preheatEstMs) *
+                                                    3 / 10
+                                : elapsed;
+    return true;
+  }
+
+  case END_UPPER:
+  case END_LOWER: {
+    bool reached = st.end == END_UPPER ? sensed.limitUpper : sensed.limitLower;
+    if (reached) {
+      hal.relayOff(st.relay);
+      if (st.phase != PH_HOME) // Homing is usually a no-op
+        mixerMoveEstMs += (long)(elapsed - mixerMoveEstMs) * 3 / 10;
+      return true;
+    }
+    if (elapsed > LIMIT_TIMEOUT_MS) {
+      hal.relayOff(st.relay);
+      setError("TIMEOUT_LIMIT");
+    }
+    return false;
+  }
+
+  default:
+    if (elapsed < st.durMs)
+      return false;
+    hal.relayOff(st.relay);
+    return true;
+  }
+}
+
+// Hold ends once neither the preheat nor a heated step is left
+void MachineController::releaseHeaterIfDone() {
+  bool left = false;
+  bool pumping = false;
+  for (uint8_t i = 0; i < planLen; i++) {
+    uint16_t bit = 1u << i;
+    bool heated = plan[i].flags & STEP_HEATED;
+    if ((plan[i].end != END_PREHEAT && !heated) || (stepDone & bit))
+      continue;
+    left = true;
+    if (heated && (stepRunning & bit))
+      pumping = true;
+  }
+  heaterPumping = pumping;
+  if (left)
+    return;
+  setHeater(false);
+  heaterHold = false;
+  heaterStartTime = 0;
+}
+
+uint16_t MachineController::submit(const OrderParams &params) {
+  if (!hal.isReady()) {
+    errorMsg = "NOT_READY";
+    return 0;
+  }
+
+  bool queueIt = isBusy() || queueLen > 0 || !sensed.cupPresent;
+  if (!queueIt) {
+    uint16_t id = takeId();
+    return startOrder(params, id) ? id : 0;
+  }
+
+  if (queueLen >= ORDER_QUEUE_MAX) {
+    LOG_WARN("FSM", "Queue full");
+    errorMsg = "QUEUE_FULL";
+    return 0;
+  }
+  QueuedOrder &q = queue[queueLen++];
+  q.id = takeId();
+  q.order = params;
+  q.queuedMs = millis();
+  LOG_INFOF("FSM", "Queued #%u %s at %u", q.id, recipeFor(params).name,
+            queueLen - 1);
+  return q.id;
+}
+
+// Head starts once idle (or errored) and a cup was placed after the last
+// order started
+bool MachineController::startQueued() {
+  if (queueLen == 0 || !cupSwapped || cupSince == 0)
+    return false;
+  if (millis() - cupSince < QUEUE_CUP_SETTLE_MS) {
+    wakeAt(cupSince + QUEUE_CUP_SETTLE_MS);
+    return false;
+  }
+
+  QueuedOrder q = queue[0];
+  for (uint8_t i = 1; i < queueLen; i++)
+    queue[i - 1] = queue[i];
+  queueLen--;
+  LOG_INFOF("FSM", "Dequeued #%u after %lus, %u left", q.id,
+            (millis() - q.queuedMs) / 1000, queueLen);
+  return startOrder(q.order, q.id);
+}
+
+int MachineController::queuePosition(uint16_t id) const {
+  for (uint8_t i = 0; i < queueLen; i++) {
+    if (queue[i].id == id)
+      return i;
+  }
+  return -1;
+}
+
+bool MachineController::cancelQueued(uint16_t id) {
+  int pos = queuePosition(id);
+  if (pos < 0)
+    return false;
+  for (uint8_t i = pos + 1; i < queueLen; i++)
+    queue[i - 1] = queue[i];
+  queueLen--;
+  return true;
+}
+
+bool MachineController::moveQueued(uint16_t id, uint8_t to) {
+  int from = queuePosition(id);
+  if (from < 0)
+    return false;
+  if (to >= queueLen)
+    to = queueLen - 1;
+  QueuedOrder q = queue[from];
+  if (to < from) {
+    for (int i = from; i > to; i--)
+      queue[i] = queue[i - 1];
+  } else {
+    for (int i = from; i < to; i++)
+      queue[i] = queue[i + 1];
+  }
+  queue[to] = q;
+  return true;
+}
+
+unsigned long MachineController::stepEstimateMs(const PlannedStep &st,
+                                                const Settings &s) const {
+  switch (st.end) {
+  case END_PREHEAT:
+    return preheatEstMs ? preheatEstMs : s.intHeaterTime * 500UL;
+  case END_UPPER:
+    if (st.phase == PH_HOME)
+      return 0; // Already up after a normal cycle
+    return mixerMoveEstMs;
+  case END_LOWER:
+    return mixerMoveEstMs;
+  default:
+    return st.durMs;
+  }
+}
+
+// Parallel steps take the longest, STEP_AFTER_PREV chains add up
+unsigned long MachineController::phaseEstimateMs(uint8_t phase,
+                                                 const PlannedStep *steps,
+                                                 uint8_t n,
+                                                 const Settings &s) const {
+  unsigned long longest = 0;
+  unsigned long chain = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    if (steps[i].phase != phase)
+      continue;
+    unsigned long ms = stepEstimateMs(steps[i], s);
+    chain = (steps[i].flags & STEP_AFTER_PREV) ? chain + ms : ms;
+    longest = max(longest, chain);
+  }
+  return longest;
+}
+
+// Deps always have a lower index, so one pass gives the critical path.
+// The power budget is ignored: a lower bound when the budget is tight.
+unsigned long MachineController::estimateMs(const OrderParams &o) const {
+  Settings s = settings.get();
+  PlannedStep steps[RECIPE_STEPS_MAX];
+  uint8_t n = buildPlan(o, s, steps);
+  uint16_t need = planPhases(steps, n);
+  unsigned long finish[PH_COUNT];
+  unsigned long total = 0;
+  for (uint8_t i = 0; i < PH_COUNT; i++) {
+    finish[i] = 0;
+    if (!(need & PH_BIT(i)))
+      continue;
+    unsigned long begin = 0;
+    for (uint8_t j = 0; j < i; j++) {
+      if ((PHASE_SPECS[i].deps & PH_BIT(j)) && finish[j] > begin)
+        begin = finish[j];
+    }
+    finish[i] = begin + phaseEstimateMs(i, steps, n, s);
+    total = max(total, finish[i]);
+  }
+  return total;
+}
+
+unsigned long MachineController::remainingMs() const {
+  if (!phases.active())
+    return 0;
+  unsigned long est = estimateMs(order);
+  unsigned long spent = millis() - pipelineStartTime;
+  return spent < est ? est - spent : 0;
+}
+
+unsigned long MachineController::waitMs(uint8_t pos) const {
+  unsigned long ms = remainingMs();
+  for (uint8_t i = 0; i < pos && i < queueLen; i++)
+    ms += estimateMs(queue[i].order);
+  return ms;
+}
@@ -0,0 +1,272 @@
+#ifndef MACHINE_CONTROLLER_H
+#define MACHINE_CONTROLLER_H
+
+#include "HAL.h"
+#include "HeaterPid.h"
+#include "PhaseScheduler.h"
+#include "Recipe.h"
+#include "SensorTask.h"
+#include "SettingsManager.h"
+#include <Arduino.h>
+
+enum MachineState {
+  IDLE,
+  VALIDATE,
+  DISPENSE_SOLIDS,
+  HEAT_INTERNAL_PREHEAT,
+  HEAT_INTERNAL_ACTIVE,
+  HEAT_EXTERNAL,
+  DISPENSE_LIQUID,
+  MIX_DOWN,
+  MIX_RUN,
+  MIX_UP,
+  DONE,
+  ERROR_STATE,
+  SAFE_STOP,
+  AUTOTUNE
+};
+
+enum DrinkMode {
+  MODE_NONE,
+  MODE_COFFEE,
+  MODE_HOTWATER,
+  MODE_NESCAFE,
+  MODE_CLEANING,
+  MODE_CUSTOM // OrderParams.recipe indexes recipes()
+};
+
+enum BrewBase { BREW_WATER, BREW_MILK };
+enum CupSize { SIZE_SINGLE, SIZE_DOUBLE };
+enum SugarLevel { SUGAR_LOW, SUGAR_MEDIUM, SUGAR_HIGH };
+enum HotLiquid { LIQUID_WATER, LIQUID_MILK_MEDIUM, LIQUID_MILK_EXTRA };
+enum MilkRatio { RATIO_NONE, RATIO_MEDIUM, RATIO_EXTRA };
+
+// Wire names, indexed by enum value (DrinkMode: MODE_NONE has none)
+extern const char *const DRINK_MODE_NAMES[];
+extern const char *const BREW_BASE_NAMES[];
+extern const char *const CUP_SIZE_NAMES[];
+extern const char *const SUGAR_LEVEL_NAMES[];
+extern const char *const HOT_LIQUID_NAMES[];
+extern const char *const MILK_RATIO_NAMES[];
+
+// Case-insensitive lookup of s in names[0..count); fallback if not found.
+int parseEnumName(const char *s, const char *const *names, int count,
+                  int fallback);
+
+// Parsed once by the HTTP layer; the FSM only compares enums.
+struct OrderParams {
+  DrinkMode mode;
+  uint8_t recipe; // MODE_CUSTOM only
+
+  BrewBase brewBase;   // Coffee
+  HotLiquid hotLiquid; // HotWater
+  MilkRatio milkRatio; // Nescafe
+
+  // Common
+  CupSize size;
+  SugarLevel sugar;
+
+  // Cleaning
+  bool cleanMilk;
+  bool cleanWater;
+};
+
+struct QueuedOrder {
+  uint16_t id; // 1-based, never 0
+  OrderParams order;
+  unsigned long queuedMs;
+};
+
+// Hooks for the firmware around the controller (stats, prompts, stock,
+// telemetry). All are called from update(), start() or stop(), on the
+// caller's task; the defaults do nothing.
+class MachineObserver {
+public:
+  virtual ~MachineObserver() {}
+  virtual void onState(MachineState /*from*/, MachineState /*to*/) {}
+  virtual void onOrderStart(uint16_t /*id*/, const OrderParams & /*o*/) {}
+  // Last VALIDATE check: an error code refuses the order, nullptr accepts it
+  virtual const char *checkPlan(const PlannedStep * /*plan*/, uint8_t /*n*/) {
+    return nullptr;
+  }
+};
+
+class MachineController {
+public:
+  MachineController(HAL &hal, SensorTask &sensors, SettingsManager &settings);
+
+  void update(); // Non-blocking FSM update
+  void setObserver(MachineObserver *o) { observer = o; }
+
+  // What the last update() waits for: the caller may sleep until
+  // nextWakeMs() (at most FSM_MAX_SLEEP_MS away) or a sensor change in
+  // wakeEvents() (SensorTask::notifyOnChange), and must call update() at once
+  // after start()/submit()/stop()/startAutoTune().
+  unsigned long nextWakeMs() const { return wakeAtMs; }
+  uint8_t wakeEvents() const { return wakeMask; }
+  // That rule for a scheduler: true if nextWakeMs() is due at ms or a watched
+  // input differs between seen (read before the last update()) and now.
+  bool wakeDue(unsigned long ms, const SensorSnapshot &seen,
+               const SensorSnapshot &now) const {
+    return (long)(ms - wakeAtMs) >= 0 ||
+           (SensorTask::changes(seen, now) & wakeMask) != 0;
+  }
+
+  // Idle power mode (IDLE_POWER_SAVE): entered by update() after
+  // IDLE_POWER_AFTER_MS idle with an empty queue and no keep-warm hold. The
+  // HTTP layer calls noteActivity() before handling each request so the
+  // request runs at CPU_MHZ_ACTIVE; a cup change counts as activity too.
+  // Wi-Fi modem-/light-sleep are not used: the softAP must stay awake.
+  void noteActivity();
+  bool isPowerSave() const { return powerSave; }
+  bool start(const OrderParams &params); // Not queued; runningId() is new
+  // Starts now if idle, the queue is empty and a cup is present, else queues.
+  // Returns the order id, 0 if rejected (getError(): NOT_READY/QUEUE_FULL).
+  uint16_t submit(const OrderParams &params);
+  bool startAutoTune(); // Thermoblock PID tuning; no cup or pump needed
+  void stop(); // SAFE_STOP for one pass, then IDLE; queued orders stay
+
+  // DONE and SAFE_STOP are shown for one pass and count as not busy
+  bool isBusy() const {
+    return state != IDLE && state != ERROR_STATE && state != DONE &&
+           state != SAFE_STOP;
+  }
+  MachineState currentState() const { return state; }
+  static const char *stateName(MachineState s);
+  const char *getState() const { return stateName(state); }
+  const char *getStep() const { return currentStep; }
+  const char *getError() const { return errorMsg; }
+  uint16_t runningPhases() const { return phases.running(); } // 1 << DrinkPhase
+  bool isKeepingWarm() const { return keepWarm; }
+  bool isPredictivePreheat() const { return keepWarm && keepWarmPredict; }
+  float heaterEnergyWh() const;   // Thermoblock, since boot
+  float keepWarmEnergyWh() const; // Share spent holding idle temperature
+  float orderGapMs() const { return orderGapEwma; } // 0 = no estimate
+
+  // Running order, or the last one once idle (id 0 = none yet)
+  uint16_t runningId() const { return orderId; }
+  const OrderParams &runningOrder() const { return order; }
+
+  // Order queue: positions are 0-based, the running order is not in it
+  uint8_t queueSize() const { return queueLen; }
+  const QueuedOrder &queuedAt(uint8_t pos) const { return queue[pos]; }
+  int queuePosition(uint16_t id) const; // -1 if not queued
+  bool cancelQueued(uint16_t id);
+  bool moveQueued(uint16_t id, uint8_t to);
+  void clearQueue() { queueLen = 0; }
+  // Critical path of the phase graph from settings, learned sensor phases
+  unsigned long estimateMs(const OrderParams &o) const;
+  unsigned long remainingMs() const; // Running order
+  unsigned long waitMs(uint8_t pos) const;
+  const char *phaseName(uint8_t phase) const;
+
+  // Custom drinks from RECIPES_PATH; refused (false) while an order runs or
+  // waits, since those hold a recipe index.
+  bool loadRecipes(fs::FS &fs);
+  const RecipeBook &recipes() const { return recipeBook; }
+  const Recipe &recipeFor(const OrderParams &o) const;
+
+private:
+  HAL &hal;
+  SensorTask &sensors;
+  SettingsManager &settings;
+  MachineObserver *observer;
+
+  MachineState state;
+  OrderParams order;
+  uint16_t orderId;
+  Settings cfg;
+  SensorSnapshot sensed; // Refreshed once per update()
+  HeaterPid heaterPid;
+  HeaterAutoTune autoTune;
+  PhaseScheduler phases;
+
+  const char *currentStep; // Always a string literal
+  const char *errorMsg;    // "" when none
+
+  unsigned long stateStartTime;
+  unsigned long heaterStartTime;
+  unsigned long pipelineStartTime;
+
+  // Step plan of the running order, resolved by start() (bit = 1 << step)
+  RecipeBook recipeBook;
+  PlannedStep plan[RECIPE_STEPS_MAX];
+  uint8_t planLen;
+  unsigned long stepStart[RECIPE_STEPS_MAX];
+  uint16_t stepRunning;
+  uint16_t stepDone;
+
+  float preheatTarget;
+  bool heaterHold;    // PID owns the heater: preheat start .. last heated step
+  bool heaterPumping; // A pump feeds the thermoblock (feed-forward)
+
+  // Keep-warm / predictive preheat (idle only)
+  unsigned long lastOrderStart;
+  unsigned long lastOrderDone; // 0 = disarmed
+  float orderGapEwma;          // ms; 0 = no estimate
+  bool keepWarm;
+  bool keepWarmPredict;
+
+  QueuedOrder queue[ORDER_QUEUE_MAX];
+  uint8_t queueLen;
+  uint16_t nextOrderId;
+  bool cupSwapped;         // Cup removed since the last order started
+  unsigned long cupSince;  // Cup present continuously since (0 = absent)
+  unsigned long preheatEstMs;   // 0 = not learned (intHeaterTime / 2)
+  unsigned long mixerMoveEstMs;
+
+  // Wake-up deadline and SENSOR_EV_* collected by update()
+  unsigned long wakeAtMs;
+  uint8_t wakeMask;
+
+  bool powerSave;
+  unsigned long activeSince; // Last activity (idle power mode)
+
+  // Thermoblock energy, W*ms
+  bool heaterOn;
+  unsigned long heaterOnSince;
+  uint64_t heaterMJ;
+  uint64_t keepWarmMJ;
+
+  void runPass();
+  bool pumpRunning() const;
+  void wakeAt(unsigned long ms);
+  void wakeOn(uint8_t events) { wakeMask |= events; }
+  void armStepWakes();
+  void setState(MachineState newState);
+  void setError(const char *error);
+  bool checkCup();
+  bool heaterSafe();
+  void safeStop();
+
+  void beginPipeline();
+  void runPipeline();
+  uint8_t buildPlan(const OrderParams &o, const Settings &s,
+                    PlannedStep *out) const;
+  bool planHeats() const;
+  uint16_t planLimitSteps() const;
+  unsigned long stepEstimateMs(const PlannedStep &st, const Settings &s) const;
+  unsigned long phaseEstimateMs(uint8_t phase, const PlannedStep *steps,
+                                uint8_t n, const Settings &s) const;
+  void trackCup();
+  uint16_t takeId();
+  bool startOrder(const OrderParams &params, uint16_t id);
+  bool startQueued();
+  uint16_t phaseWatts(uint8_t phase) const;
+  void startPhase(uint8_t phase, unsigned long now);
+  bool stepPhase(uint8_t phase, unsigned long now); // True when done
+  int prevInPhase(uint8_t step) const;
+  void startStep(uint8_t step, unsigned long now);
+  bool runStep(uint8_t step, unsigned long now); // True when done
+  void releaseHeaterIfDone();
+  void showLeadingPhase();
+  void runAutoTune();
+  void heaterControl(float setpoint, bool pumping);
+  void setHeater(bool on);
+  void runKeepWarm();
+  void stopKeepWarm(const char *why);
+  void disarmKeepWarm(const char *why);
+  void runIdlePower();
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "Max6675Bus.h"
+#include "Logger.h"
+#include <esp_heap_caps.h>
+
+static const int CS_PINS[Max6675Bus::CHANNEL_COUNT] = {CS_INTERNAL,
+                                                       CS_EXTERNAL};
+
+Max6675Bus::Max6675Bus() : intervalMs(TEMP_SAMPLE_MS) {
+  for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+    dev[ch] = nullptr;
+    rx[ch] = nullptr;
+    inFlight[ch] = false;
+    lastReadMs[ch] = 0;
+    cached[ch] = NAN;
+  }
+}
+
+bool Max6675Bus::begin() {
+  spi_bus_config_t bus = {};
+  bus.mosi_io_num = -1; // Read-only chip
+  bus.miso_io_num = SPI_MISO;
+  bus.sclk_io_num = SPI_SCK;
+  bus.quadwp_io_num = -1;
+  bus.quadhd_io_num = -1;
+  bus.max_transfer_sz = 4;
+  if (spi_bus_initialize(MAX6675_SPI_HOST, &bus, SPI_DMA_CH_AUTO) != ESP_OK) {
+    LOG_ERROR("MAX6675", "SPI bus init failed");
+    return false;
+  }
+
+  for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+    if (CS_PINS[ch] < 0)
+      continue; // Not fitted on this board: stays NAN
+    spi_device_interface_config_t cfg = {};
+    cfg.mode = 0;
+    cfg.clock_speed_hz = MAX6675_SPI_HZ;
+    cfg.spics_io_num = CS_PINS[ch];
+    cfg.queue_size = 1;
+    if (spi_bus_add_device(MAX6675_SPI_HOST, &cfg, &dev[ch]) != ESP_OK) {
+      LOG_ERROR("MAX6675", "SPI device add failed");
+      return false;
+    }
+
+    rx[ch] = (uint8_t *)heap_caps_malloc(4, MALLOC_CAP_DMA);
+    if (!rx[ch]) { // Channel stays NAN
+      LOG_ERROR("MAX6675", "DMA buffer alloc failed");
+      spi_bus_remove_device(dev[ch]);
+      dev[ch] = nullptr;
+      return false;
+    }
+    memset(&trans[ch], 0, sizeof(trans[ch]));
+    trans[ch].length = 16;
+    trans[ch].rx_buffer = rx[ch];
+  }
+
+  LOG_INFO("MAX6675", "SPI bus ready");
+  return true;
+}
+
+void Max6675Bus::poll() {
+  unsigned long now = millis();
+
+  for (int ch = 0; ch < CHANNEL_COUNT; ch++) {
+    if (!dev[ch])
+      continue;
+
+    if (inFlight[ch]) {
+      spi_transaction_t *done = nullptr;
+      if (spi_device_get_trans_result(dev[ch], &done, 0) != ESP_OK)
+        continue;
+      inFlight[ch] = false;
+      lastReadMs[ch] = now; // CS released: next conversion starts now
+      cached[ch] = decode(((uint16_t)rx[ch][0] << 8) | rx[ch][1]);
+      continue;
+    }
+
+    // Reading early would abort the running conversion
+    if (now - lastReadMs[ch] < intervalMs)
+      continue;
+    if (spi_device_queue_trans(dev[ch], &trans[ch], 0) == ESP_OK)
+      inFlight[ch] = true;
+  }
+}
+
+void Max6675Bus::setInterval(unsigned long ms) {
+  intervalMs = ms < MAX6675_CONVERSION_MS ? MAX6675_CONVERSION_MS : ms;
+}
+
+float Max6675Bus::decode(uint16_t raw) {
+  if (raw & 0x0004) // Thermocouple open
+    return NAN;
+  float c = ((raw >> 3) & 0x0FFF) * 0.25f;
+  return c > MAX6675_MAX_C ? NAN : c; // Garbled frame (bus noise)
+}
@@ -0,0 +1,35 @@
+#ifndef MAX6675_BUS_H
+#define MAX6675_BUS_H
+
+#include "Config.h"
+#include <Arduino.h>
+#include <driver/spi_master.h>
+
+// Both MAX6675 chips on one hardware SPI bus, one device per CS.
+// poll() queues a DMA read when a channel's conversion has finished and
+// collects completed ones; it never waits. celsius() returns the cached value.
+class Max6675Bus {
+public:
+  enum Channel { INTERNAL_TC = 0, EXTERNAL_TC = 1, CHANNEL_COUNT = 2 };
+
+  Max6675Bus();
+  bool begin();
+  void poll();
+  void setInterval(unsigned long ms); // Read period, >= MAX6675_CONVERSION_MS
+
+  float celsius(Channel ch) const { return cached[ch]; }
+  unsigned long sampleMs(Channel ch) const { return lastReadMs[ch]; }
+
+private:
+  spi_device_handle_t dev[CHANNEL_COUNT];
+  spi_transaction_t trans[CHANNEL_COUNT];
+  uint8_t *rx[CHANNEL_COUNT];
+  bool inFlight[CHANNEL_COUNT];
+  unsigned long lastReadMs[CHANNEL_COUNT];
+  float cached[CHANNEL_COUNT];
+  unsigned long intervalMs;
+
+  static float decode(uint16_t raw);
+};
+
+#endif
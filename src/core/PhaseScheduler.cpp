@@ -0,0 +1,75 @@
+#include "PhaseScheduler.h"
+#include "Logger.h"
+
+PhaseScheduler::PhaseScheduler() { reset(); }
+
+void PhaseScheduler::reset() {
+  specs = nullptr;
+  count = 0;
+  budget = 0;
+  done = 0;
+  runMask = 0;
+  for (int i = 0; i < PHASE_MAX; i++) {
+    watts[i] = 0;
+    startMs[i] = 0;
+  }
+}
+
+void PhaseScheduler::begin(const PhaseSpec *specTable, uint8_t n,
+                           uint16_t needed, uint16_t budgetW) {
+  reset();
+  specs = specTable;
+  count = n > PHASE_MAX ? PHASE_MAX : n;
+  budget = budgetW;
+  done = allMask() & (uint16_t)~needed;
+  LOG_INFOF("FSM", "Pipeline: phases=0x%03x budget=%uW", needed, budgetW);
+}
+
+void PhaseScheduler::setWatts(uint8_t phase, uint16_t w) {
+  if (phase < PHASE_MAX)
+    watts[phase] = w;
+}
+
+uint16_t PhaseScheduler::runningWatts() const {
+  uint16_t w = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (runMask & (1u << i))
+      w += watts[i];
+  }
+  return w;
+}
+
+uint16_t PhaseScheduler::startReady(uint16_t heldW, unsigned long now) {
+  if (!specs)
+    return 0;
+
+  uint16_t started = 0;
+  uint32_t load = heldW + runningWatts();
+  for (uint8_t i = 0; i < count; i++) {
+    uint16_t bit = 1u << i;
+    if ((done | runMask) & bit)
+      continue;
+    if (specs[i].deps & (uint16_t)~done)
+      continue;
+    if (runMask != 0 && load + watts[i] > budget)
+      continue;
+
+    runMask |= bit;
+    started |= bit;
+    load += watts[i];
+    startMs[i] = now;
+    LOG_INFOF("FSM", "Phase start: %s (%luW)", specs[i].name,
+              (unsigned long)load);
+  }
+  return started;
+}
+
+void PhaseScheduler::finish(uint8_t phase, unsigned long now) {
+  uint16_t bit = 1u << phase;
+  if (!(runMask & bit))
+    return;
+  runMask &= (uint16_t)~bit;
+  done |= bit;
+  LOG_INFOF("FSM", "Phase done: %s in %lums", specs[phase].name,
+            now - startMs[phase]);
+}
@@ -0,0 +1,52 @@
+#ifndef PHASE_SCHEDULER_H
+#define PHASE_SCHEDULER_H
+
+#include <Arduino.h>
+
+#define PHASE_MAX 16
+
+// One drink as a dependency graph: a phase is ready once every phase in its
+// deps mask is done, and startReady() starts it if the watts of the running
+// phases (plus any held load) and its own fit the budget. When nothing runs
+// the next ready phase always starts, so a tight budget falls back to serial
+// order instead of stalling.
+struct PhaseSpec {
+  const char *name;
+  uint16_t deps; // Bit i = phase i must be done first
+};
+
+class PhaseScheduler {
+public:
+  PhaseScheduler();
+
+  // Phases outside `needed` count as done from the start
+  void begin(const PhaseSpec *specs, uint8_t count, uint16_t needed,
+             uint16_t budgetW);
+  void setWatts(uint8_t phase, uint16_t watts);
+  void reset();
+
+  // Starts every ready phase that fits; returns the mask of phases started
+  uint16_t startReady(uint16_t heldW, unsigned long now);
+  void finish(uint8_t phase, unsigned long now);
+
+  bool active() const { return specs != nullptr; }
+  bool allDone() const { return specs && done == allMask(); }
+  uint16_t running() const { return runMask; }
+  bool isRunning(uint8_t phase) const { return runMask & (1u << phase); }
+  unsigned long startedAt(uint8_t phase) const { return startMs[phase]; }
+  uint16_t runningWatts() const;
+  const char *name(uint8_t phase) const { return specs[phase].name; }
+
+private:
+  const PhaseSpec *specs;
+  uint8_t count;
+  uint16_t budget;
+  uint16_t done;
+  uint16_t runMask;
+  uint16_t watts[PHASE_MAX];
+  unsigned long startMs[PHASE_MAX];
+
+  uint16_t allMask() const { return (uint16_t)((1u << count) - 1); }
+};
+
+#endif
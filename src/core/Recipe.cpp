@@ -0,0 +1,161 @@
+#include "Recipe.h"
+#include "Logger.h"
+#include <ArduinoJson.h>
+
+// JSON relay index -> pin, same order as the single-file firmware
+static const uint8_t RELAY_BY_INDEX[10] = {
+    RELAY_TANK1_SUGAR,     RELAY_TANK2_COFFEE, RELAY_TANK3_NESCAFE,
+    RELAY_PUMP_WATER,      RELAY_PUMP_MILK,    RELAY_HEATER_INTERNAL,
+    RELAY_HEATER_EXTERNAL, RELAY_MIXER_ROTATE, RELAY_MIXER_UP,
+    RELAY_MIXER_DOWN};
+
+static const char *const END_NAMES[END_COUNT] = {"timer", "upper", "lower",
+                                                 "preheat"};
+static const char *const TIME_NAMES[TIME_COUNT] = {
+    "none", "tank1",     "tank2", "tank3", "water",
+    "milk", "extHeater", "mixer", "fixed"};
+static const char *const SCALE_NAMES[SCALE_COUNT] = {
+    "one", "size", "sugar", "hotMilk", "nescafeWater", "nescafeMilk"};
+static const char *const GUARD_NAMES[GUARD_COUNT] = {
+    "always",  "brewWater",  "brewMilk", "hotWater",
+    "hotMilk", "cleanWater", "cleanMilk"};
+
+// Missing key -> fallback, unknown name -> -1
+static int lookup(JsonObjectConst js, const char *key,
+                  const char *const *names, int count, int fallback) {
+  if (!js.containsKey(key))
+    return fallback;
+  const char *s = js[key].as<const char *>();
+  for (int i = 0; s && i < count; i++) {
+    if (strcasecmp(s, names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// False with why set if the step is not acceptable. The heater may only be
+// switched by a PREHEAT step ending on "preheat" (PID-driven, never timed).
+static bool parseStep(JsonObjectConst js, const PhaseSpec *phases,
+                      uint8_t phaseCount, RecipeStep &st, const char *&why) {
+  int phase = -1;
+  const char *phaseName = js["phase"].as<const char *>();
+  for (uint8_t i = 0; phaseName && i < phaseCount; i++) {
+    if (strcasecmp(phaseName, phases[i].name) == 0)
+      phase = i;
+  }
+  int end = lookup(js, "end", END_NAMES, END_COUNT, END_TIMER);
+  int time = lookup(js, "time", TIME_NAMES, TIME_COUNT, TIME_NONE);
+  int scale = lookup(js, "scale", SCALE_NAMES, SCALE_COUNT, SCALE_ONE);
+  int guard = lookup(js, "guard", GUARD_NAMES, GUARD_COUNT, GUARD_ALWAYS);
+  int relay = js["relay"] | -1;
+  float sec = js["sec"] | 0.0f;
+
+  if (phase < 0 || end < 0 || time < 0 || scale < 0 || guard < 0) {
+    why = "unknown name";
+    return false;
+  }
+  if (relay < 0 || relay > 9) {
+    why = "bad relay";
+    return false;
+  }
+  uint8_t pin = RELAY_BY_INDEX[relay];
+  bool heater = pin == RELAY_HEATER_INTERNAL;
+  if (heater != (end == END_PREHEAT) || heater != (phase == PH_PREHEAT)) {
+    why = "heater only as PREHEAT/preheat";
+    return false;
+  }
+  if ((end == END_UPPER && pin != RELAY_MIXER_UP) ||
+      (end == END_LOWER && pin != RELAY_MIXER_DOWN)) {
+    why = "limit end needs mixer up/down";
+    return false;
+  }
+  if (sec < 0 || sec > 600) {
+    why = "bad sec";
+    return false;
+  }
+
+  st.phase = phase;
+  st.relay = pin;
+  st.time = time;
+  st.scale = scale;
+  st.guard = guard;
+  st.end = end;
+  st.flags = ((js["after"] | false) ? STEP_AFTER_PREV : 0) |
+             ((js["heated"] | false) ? STEP_HEATED : 0);
+  st.fixedDs = (uint16_t)(sec * 10 + 0.5f);
+  return true;
+}
+
+RecipeBook::RecipeBook() : count(0) {}
+
+int RecipeBook::find(const char *name) const {
+  for (uint8_t i = 0; name && i < count; i++) {
+    if (strcasecmp(name, recipes[i].name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+uint8_t RecipeBook::load(fs::FS &fs, const char *path,
+                         const PhaseSpec *phases, uint8_t phaseCount) {
+  count = 0;
+  File f = fs.open(path, "r");
+  if (!f)
+    return 0;
+
+  DynamicJsonDocument doc(4096);
+  DeserializationError err = deserializeJson(doc, f);
+  f.close();
+  if (err) {
+    LOG_ERRORF("RECIPE", "%s: %s", path, err.c_str());
+    return 0;
+  }
+
+  for (JsonObjectConst jr : doc.as<JsonArrayConst>()) {
+    const char *name = jr["name"].as<const char *>();
+    if (!name || !*name || strlen(name) >= sizeof(names[0]) ||
+        find(name) >= 0) {
+      LOG_WARNF("RECIPE", "Skipped: bad or duplicate name '%s'",
+                name ? name : "");
+      continue;
+    }
+    if (count >= CUSTOM_RECIPE_MAX) {
+      LOG_WARNF("RECIPE", "Skipped %s: more than %d recipes", name,
+                CUSTOM_RECIPE_MAX);
+      break;
+    }
+
+    uint8_t n = 0;
+    bool heated = false;
+    bool preheat = false;
+    const char *why = nullptr;
+    for (JsonObjectConst js : jr["steps"].as<JsonArrayConst>()) {
+      if (n >= RECIPE_STEPS_MAX) {
+        why = "too many steps";
+        break;
+      }
+      RecipeStep &st = steps[count][n];
+      if (!parseStep(js, phases, phaseCount, st, why))
+        break;
+      heated |= (st.flags & STEP_HEATED) != 0;
+      preheat |= st.end == END_PREHEAT;
+      n++;
+    }
+    if (!why && n == 0)
+      why = "no steps";
+    if (!why && heated && !preheat)
+      why = "heated step without PREHEAT";
+    if (why) {
+      LOG_WARNF("RECIPE", "Skipped %s: step %u %s", name, n, why);
+      continue;
+    }
+
+    strcpy(names[count], name);
+    recipes[count].name = names[count];
+    recipes[count].steps = steps[count];
+    recipes[count].count = n;
+    count++;
+    LOG_INFOF("RECIPE", "Loaded %s (%u steps)", name, n);
+  }
+  return count;
+}
@@ -0,0 +1,115 @@
+#ifndef RECIPE_H
+#define RECIPE_H
+
+#include "Config.h"
+#include "PhaseScheduler.h"
+#include <FS.h>
+
+// Drink phases run by the overlap pipeline (see PhaseScheduler.h). Index
+// order is start priority; the lowest running one is reported as the state.
+enum DrinkPhase {
+  PH_PREHEAT,
+  PH_SUGAR,
+  PH_SOLIDS,
+  PH_HOME, // Mixer to upper limit before it is lowered
+  PH_CLEAN,
+  PH_COFFEE_LIQUID,
+  PH_HOT_LIQUID,
+  PH_NESCAFE_LIQUID,
+  PH_EXT_WARM,
+  PH_MIX_DOWN,
+  PH_MIX_RUN,
+  PH_MIX_UP,
+  PH_COUNT
+};
+
+// A drink as a table of steps run by one interpreter (MachineController).
+// Each step belongs to a phase of the graph, which gives it deps, a share of
+// the power budget and the reported state; steps of one phase run together
+// unless STEP_AFTER_PREV. Guards drop steps that do not apply to the order
+// and the on-time is a setting times a scale, both resolved once at start().
+enum StepEnd { END_TIMER, END_UPPER, END_LOWER, END_PREHEAT, END_COUNT };
+enum StepTime {
+  TIME_NONE,
+  TIME_TANK1,
+  TIME_TANK2,
+  TIME_TANK3,
+  TIME_WATER,
+  TIME_MILK,
+  TIME_EXT_HEATER,
+  TIME_MIXER,
+  TIME_FIXED, // fixedDs
+  TIME_COUNT
+};
+enum StepScale {
+  SCALE_ONE,
+  SCALE_SIZE,
+  SCALE_SUGAR,
+  SCALE_HOT_MILK,     // Size, milk extra doubles
+  SCALE_NES_WATER,    // Size x water share of milkRatio
+  SCALE_NES_MILK,     // Size x milk share of milkRatio
+  SCALE_COUNT
+};
+enum StepGuard {
+  GUARD_ALWAYS,
+  GUARD_BREW_WATER,
+  GUARD_BREW_MILK,
+  GUARD_HOT_WATER,
+  GUARD_HOT_MILK,
+  GUARD_CLEAN_WATER,
+  GUARD_CLEAN_MILK,
+  GUARD_COUNT
+};
+
+#define STEP_AFTER_PREV 0x01 // Starts when the previous step of its phase is done
+#define STEP_HEATED 0x02     // Flows through the thermoblock (heater held, FF)
+
+struct RecipeStep {
+  uint8_t phase;    // DrinkPhase
+  uint8_t relay;    // RELAY_* pin; the heater only on a PREHEAT step
+  uint8_t time;     // StepTime, END_TIMER only
+  uint8_t scale;    // StepScale
+  uint8_t guard;    // StepGuard
+  uint8_t end;      // StepEnd
+  uint8_t flags;    // STEP_*
+  uint16_t fixedDs; // TIME_FIXED base, 0.1 s
+};
+
+struct Recipe {
+  const char *name; // Order mode name, case-insensitive
+  const RecipeStep *steps;
+  uint8_t count;
+};
+
+// One step of the running order after guards and on-times are resolved
+struct PlannedStep {
+  uint8_t phase;
+  uint8_t relay;
+  uint8_t end;
+  uint8_t flags;
+  unsigned long durMs;
+};
+
+// Custom drinks loaded from a JSON file (same format as the single-file
+// firmware's /recipes.json; relays are indexed 0..9 in RELAY_* order).
+class RecipeBook {
+public:
+  RecipeBook();
+
+  // Replaces the custom recipes; returns how many were accepted
+  uint8_t load(fs::FS &fs, const char *path, const PhaseSpec *phases,
+               uint8_t phaseCount);
+  void clear() { count = 0; }
+
+  uint8_t size() const { return count; }
+  const Recipe &at(uint8_t i) const { return recipes[i]; }
+  int find(const char *name) const; // -1 if not loaded
+
+private:
+  Recipe recipes[CUSTOM_RECIPE_MAX];
+  RecipeStep steps[CUSTOM_RECIPE_MAX][RECIPE_STEPS_MAX];
+  char names[CUSTOM_RECIPE_MAX][16];
+  uint8_t count;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "SensorTask.h"
+#include "Logger.h"
+
+SensorTask::SensorTask(HAL &halRef)
+    : hal(halRef), seq(0), handle(nullptr), waiter(nullptr), waitEvents(0),
+      idle(false), cupFast(false), slow(false) {
+  snapshot.cupDistanceCm = NAN;
+  snapshot.cupPresent = false;
+  snapshot.cupConfidence = 0;
+  snapshot.intTemp = NAN;
+  snapshot.extTemp = NAN;
+  snapshot.limitUpper = false;
+  snapshot.limitLower = false;
+  snapshot.cupSampleMs = 0;
+  snapshot.tempSampleMs = 0;
+  snapshot.tempFailCount = 0;
+  snapshot.limitSampleMs = 0;
+  last = snapshot;
+}
+
+bool SensorTask::begin() {
+  BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "sensors",
+                                          SENSOR_TASK_STACK, this,
+                                          SENSOR_TASK_PRIORITY, &handle,
+                                          SENSOR_TASK_CORE);
+  if (ok != pdPASS) {
+    LOG_ERROR("SENSORS", "Task create failed");
+    return false;
+  }
+  LOG_INFO("SENSORS", "Acquisition task started");
+  return true;
+}
+
+void SensorTask::notifyOnChange(TaskHandle_t task, uint8_t events) {
+  waitEvents.store(events);
+  waiter.store(task);
+}
+
+uint8_t SensorTask::changes(const SensorSnapshot &a, const SensorSnapshot &b) {
+  uint8_t ev = 0;
+  if (a.cupPresent != b.cupPresent ||
+      (a.cupConfidence >= CUP_SETTLED_PCT) !=
+          (b.cupConfidence >= CUP_SETTLED_PCT))
+    ev |= SENSOR_EV_CUP;
+  if (a.limitUpper != b.limitUpper || a.limitLower != b.limitLower)
+    ev |= SENSOR_EV_LIMIT;
+  if (a.tempSampleMs != b.tempSampleMs)
+    ev |= SENSOR_EV_TEMP;
+  return ev;
+}
+
+void SensorTask::taskEntry(void *arg) { static_cast<SensorTask *>(arg)->run(); }
+
+void SensorTask::run() {
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    poll();
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(slow ? SENSOR_TASK_IDLE_PERIOD_MS
+                                              : DEBOUNCE_INTERVAL_MS));
+  }
+}
+
+void SensorTask::poll() {
+  unsigned long now = millis();
+  if (idle.load() != slow) { // HAL is only touched from this task
+    slow = !slow;
+    hal.setIdleRates(slow);
+  }
+
+  SensorSnapshot s;
+  hal.setCupFast(cupFast.load());
+  s.cupPresent = hal.cupPresent();
+  s.cupConfidence = hal.cupConfidence();
+  s.cupDistanceCm = hal.cupDistanceCm();
+  s.cupSampleMs = now;
+
+  s.limitUpper = hal.readLimitUpper();
+  s.limitLower = hal.readLimitLower();
+  s.limitSampleMs = now;
+
+  hal.pollThermocouples();
+  s.intTemp = hal.readInternalTemp();
+  s.extTemp = hal.readExternalTemp();
+  s.tempSampleMs = hal.tempSampleMs();
+  s.tempFailCount = last.tempFailCount;
+  if (s.tempSampleMs != last.tempSampleMs) // Counted once per sample
+    s.tempFailCount =
+        isnan(s.intTemp) ? min(last.tempFailCount + 1, 255) : 0;
+
+  publish(s);
+  TaskHandle_t w = waiter.load();
+  if (w && (changes(last, s) & waitEvents.load()))
+    xTaskNotifyGive(w);
+  last = s;
+}
+
+void SensorTask::publish(const SensorSnapshot &s) {
+  uint32_t v = seq.load(std::memory_order_relaxed);
+  seq.store(v + 1, std::memory_order_relaxed); // Odd: write in progress
+  std::atomic_thread_fence(std::memory_order_release);
+  snapshot = s;
+  seq.store(v + 2, std::memory_order_release);
+}
+
+void SensorTask::read(SensorSnapshot &out) const {
+  uint32_t before, after;
+  do {
+    before = seq.load(std::memory_order_acquire);
+    out = snapshot;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = seq.load(std::memory_order_relaxed);
+  } while ((before & 1u) || before != after);
+}
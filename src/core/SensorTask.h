@@ -0,0 +1,66 @@
+#ifndef SENSOR_TASK_H
+#define SENSOR_TASK_H
+
+#include "HAL.h"
+#include <Arduino.h>
+#include <atomic>
+
+struct SensorSnapshot {
+  float cupDistanceCm; // NAN if no echo
+  bool cupPresent;       // Filtered
+  uint8_t cupConfidence; // 0..100
+  float intTemp; // NAN if not available
+  float extTemp; // Telemetry only
+  uint8_t tempFailCount; // Internal NAN samples in a row (SENSOR_FAIL)
+  bool limitUpper;
+  bool limitLower;
+  unsigned long cupSampleMs;
+  unsigned long tempSampleMs;
+  unsigned long limitSampleMs;
+};
+
+// Snapshot fields a waiter can be notified about (notifyOnChange)
+#define SENSOR_EV_CUP 0x01   // cupPresent, or the cup filter (un)settled
+#define SENSOR_EV_LIMIT 0x02 // limitUpper / limitLower
+#define SENSOR_EV_TEMP 0x04  // New MAX6675 sample
+
+// Samples all HAL sensors from a task pinned to SENSOR_TASK_CORE and
+// publishes them through a seqlock, so readers never block the writer.
+class SensorTask {
+public:
+  explicit SensorTask(HAL &hal);
+  bool begin();
+  TaskHandle_t task() const { return handle; } // nullptr before begin()
+  void read(SensorSnapshot &out) const; // Lock-free, callable from any task
+  // One acquisition pass: sample, publish, notify. The task's loop body;
+  // the native simulation calls it directly instead of begin().
+  void poll();
+
+  // xTaskNotifyGive(task) after a publish that changed one of events
+  // (SENSOR_EV_*); replaces the previous waiter/mask, nullptr stops it.
+  void notifyOnChange(TaskHandle_t task, uint8_t events);
+  static uint8_t changes(const SensorSnapshot &a, const SensorSnapshot &b);
+
+  // Idle power mode: slower task period and HAL sample rates
+  void setIdle(bool on) { idle.store(on); }
+  // Cup pings at CUP_SAMPLE_FAST_MS (starting, pouring)
+  void setCupFast(bool on) { cupFast.store(on); }
+
+private:
+  HAL &hal;
+  SensorSnapshot snapshot;
+  std::atomic<uint32_t> seq;
+  TaskHandle_t handle;
+  std::atomic<TaskHandle_t> waiter;
+  std::atomic<uint8_t> waitEvents;
+  std::atomic<bool> idle;
+  std::atomic<bool> cupFast;
+  SensorSnapshot last; // Previous pass, for notifyOnChange()
+  bool slow;           // Idle rates applied to the HAL
+
+  static void taskEntry(void *arg);
+  void run();
+  void publish(const SensorSnapshot &s);
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "SettingsManager.h"
+#include "Crc32.h"
+#include "Logger.h"
+#include <math.h>
+#include <stddef.h>
+
+enum FieldType : uint8_t { FIELD_INT, FIELD_FLOAT, FIELD_BOOL };
+
+struct SettingField {
+  const char *key; // Legacy per-field NVS key
+  FieldType type;
+  uint16_t offset;
+};
+
+#define FIELD(f, key, type) {key, type, (uint16_t)offsetof(Settings, f)}
+// clang-format off
+static const SettingField FIELDS[] = {
+    FIELD(tank1Time,      "tank1Time",     FIELD_INT),
+    FIELD(tank2Time,      "tank2Time",     FIELD_INT),
+    FIELD(tank3Time,      "tank3Time",     FIELD_INT),
+    FIELD(waterPumpTime,  "waterPumpTime", FIELD_INT),
+    FIELD(milkPumpTime,   "milkPumpTime",  FIELD_INT),
+    FIELD(intHeaterTime,  "intHeaterTime", FIELD_INT),
+    FIELD(intHeaterTemp,  "intHeaterTemp", FIELD_INT),
+    FIELD(extHeaterTime,  "extHeaterTime", FIELD_INT),
+    FIELD(extHeaterTemp,  "extHeaterTemp", FIELD_INT),
+    FIELD(mixerTime,      "mixerTime",     FIELD_INT),
+    FIELD(audioVolume,    "audioVolume",   FIELD_INT),
+    FIELD(audioMuted,     "audioMuted",    FIELD_BOOL),
+    FIELD(pidKp,          "pidKp",         FIELD_FLOAT),
+    FIELD(pidKi,          "pidKi",         FIELD_FLOAT),
+    FIELD(pidKd,          "pidKd",         FIELD_FLOAT),
+    FIELD(pidFf,          "pidFf",         FIELD_FLOAT),
+    FIELD(powerBudgetW,   "powerBudgetW",  FIELD_INT),
+    FIELD(standbyTemp,    "standbyTemp",   FIELD_INT),
+    FIELD(standbyMin,     "standbyMin",    FIELD_INT),
+    FIELD(predictPreheat, "predictHeat",   FIELD_BOOL),
+};
+// clang-format on
+#undef FIELD
+static const uint8_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+// Fields are only ever appended: an older, smaller blob loads over defaults
+struct SettingsBlob {
+  uint16_t version;
+  uint16_t size; // sizeof(Settings) when written
+  Settings s;
+  uint32_t crc; // CRC-32 of the bytes before it
+};
+
+static bool fieldEqual(const Settings &a, const Settings &b, const SettingField &f) {
+  const uint8_t *pa = (const uint8_t *)&a + f.offset;
+  const uint8_t *pb = (const uint8_t *)&b + f.offset;
+  switch (f.type) {
+  case FIELD_INT:
+    return *(const int *)pa == *(const int *)pb;
+  case FIELD_FLOAT:
+    return *(const float *)pa == *(const float *)pb;
+  default:
+    return *(const bool *)pa == *(const bool *)pb;
+  }
+}
+
+// Number of differing fields; their keys, comma-separated, into keys
+static uint8_t diffFields(const Settings &a, const Settings &b, char *keys,
+                          size_t keysLen) {
+  uint8_t n = 0;
+  size_t used = 0;
+  if (keysLen)
+    keys[0] = 0;
+  for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+    if (fieldEqual(a, b, FIELDS[i]))
+      continue;
+    if (used < keysLen) {
+      int w = snprintf(keys + used, keysLen - used, "%s%s", n ? "," : "",
+                       FIELDS[i].key);
+      if (w > 0)
+        used += w;
+    }
+    n++;
+  }
+  return n;
+}
+
+static int clampInt(int v, int lo, int hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static float clampFloat(float v, float lo, float hi) {
+  if (isnan(v))
+    return lo;
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+SettingsManager::SettingsManager() : dirtySince(0), changedAt(0) {
+  loadDefaults();
+  stored = current;
+}
+
+void SettingsManager::begin() {
+  // Stays open: every later commit is one putBytes()
+  prefs.begin("coffee", false);
+
+  const char *from = "NVS";
+  if (!readBlob(current)) {
+    loadDefaults();
+    if (migrateLegacy(current))
+      from = "legacy keys";
+    else
+      from = "defaults";
+  }
+  stored = current;
+  LOG_INFOF("SETTINGS", "Loaded from %s (clamped)", from);
+}
+
+bool SettingsManager::readBlob(Settings &out) {
+  const size_t hdr = offsetof(SettingsBlob, s);
+  if (!prefs.isKey(SETTINGS_BLOB_KEY))
+    return false;
+  uint8_t raw[sizeof(SettingsBlob) + 64];
+  size_t n = prefs.getBytesLength(SETTINGS_BLOB_KEY);
+  if (n < hdr + sizeof(uint32_t) || n > sizeof(raw) ||
+      prefs.getBytes(SETTINGS_BLOB_KEY, raw, n) != n) {
+    LOG_ERRORF("SETTINGS", "SettingsBlob unreadable (%u bytes)", (unsigned)n);
+    return false;
+  }
+
+  uint16_t version, size;
+  uint32_t crc;
+  memcpy(&version, raw, sizeof(version));
+  memcpy(&size, raw + sizeof(version), sizeof(size));
+  if (hdr + size + sizeof(crc) != n) {
+    LOG_ERROR("SETTINGS", "SettingsBlob size mismatch");
+    return false;
+  }
+  memcpy(&crc, raw + hdr + size, sizeof(crc));
+  if (crc32Update(0, raw, hdr + size) != crc) {
+    LOG_ERROR("SETTINGS", "SettingsBlob CRC mismatch");
+    return false;
+  }
+  if (version != SETTINGS_BLOB_VERSION) {
+    LOG_WARNF("SETTINGS", "SettingsBlob version %u unknown", version);
+    return false;
+  }
+
+  Settings s = current; // Defaults for fields a smaller blob lacks
+  memcpy(&s, raw + hdr, size < sizeof(Settings) ? size : sizeof(Settings));
+  clamp(s);
+  out = s;
+  return true;
+}
+
+bool SettingsManager::writeBlob(const Settings &s) {
+  SettingsBlob b;
+  memset(&b, 0, sizeof(b));
+  b.version = SETTINGS_BLOB_VERSION;
+  b.size = sizeof(Settings);
+  b.s = s;
+  b.crc = crc32Update(0, (const uint8_t *)&b, offsetof(SettingsBlob, crc));
+  return prefs.putBytes(SETTINGS_BLOB_KEY, &b, sizeof(b)) == sizeof(b);
+}
+
+// Old firmware wrote one key per field: read, write the blob, drop the keys
+bool SettingsManager::migrateLegacy(Settings &s) {
+  if (!prefs.isKey("tank1Time"))
+    return false;
+  Settings m = s;
+  for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+    const SettingField &f = FIELDS[i];
+    uint8_t *p = (uint8_t *)&m + f.offset;
+    switch (f.type) {
+    case FIELD_INT:
+      *(int *)p = prefs.getInt(f.key, *(int *)p);
+      break;
+    case FIELD_FLOAT:
+      *(float *)p = prefs.getFloat(f.key, *(float *)p);
+      break;
+    default:
+      *(bool *)p = prefs.getBool(f.key, *(bool *)p);
+      break;
+    }
+  }
+  clamp(m);
+  s = m;
+  if (!writeBlob(s)) {
+    LOG_ERROR("SETTINGS", "Migration: blob write failed");
+    return true;
+  }
+  for (uint8_t i = 0; i < FIELD_COUNT; i++)
+    prefs.remove(FIELDS[i].key);
+  LOG_INFOF("SETTINGS", "Migrated %u keys to one blob", FIELD_COUNT);
+  return true;
+}
+
+void SettingsManager::loadDefaults() {
+  current.tank1Time = 2;
+  current.tank2Time = 3;
+  current.tank3Time = 3;
+  current.waterPumpTime = 5;
+  current.milkPumpTime = 4;
+  current.intHeaterTime = 30;
+  current.intHeaterTemp = 95;
+  current.extHeaterTime = 45;
+  current.extHeaterTemp = 90;
+  current.mixerTime = 10;
+  current.audioVolume = 80;
+  current.audioMuted = false;
+  current.pidKp = 8.0;
+  current.pidKi = 0.2;
+  current.pidKd = 20.0;
+  current.pidFf = 35.0;
+  current.powerBudgetW = POWER_BUDGET_W_DEFAULT;
+  current.standbyTemp = 75;
+  current.standbyMin = 10;
+  current.predictPreheat = true;
+}
+
+bool SettingsManager::validate(const Settings &s) {
+  return (s.tank1Time >= 0 && s.tank1Time <= 30 && s.tank2Time >= 0 &&
+          s.tank2Time <= 30 && s.tank3Time >= 0 && s.tank3Time <= 30 &&
+          s.waterPumpTime >= 0 && s.waterPumpTime <= 60 &&
+          s.milkPumpTime >= 0 && s.milkPumpTime <= 60 &&
+          s.intHeaterTime >= 10 && s.intHeaterTime <= 120 &&
+          s.intHeaterTemp >= 60 && s.intHeaterTemp <= 100 &&
+          s.extHeaterTime >= 10 && s.extHeaterTime <= 180 &&
+          s.extHeaterTemp >= 60 && s.extHeaterTemp <= 100 && s.mixerTime >= 5 &&
+          s.mixerTime <= 60 && s.audioVolume >= 0 && s.audioVolume <= 100 &&
+          s.pidKp >= 0 && s.pidKp <= 50 &&
+          s.pidKi >= 0 && s.pidKi <= 5 && s.pidKd >= 0 && s.pidKd <= 200 &&
+          s.pidFf >= 0 && s.pidFf <= 100 && s.powerBudgetW >= 100 &&
+          s.powerBudgetW <= 4000 && s.standbyTemp >= 40 &&
+          s.standbyTemp <= 95 && s.standbyMin >= 0 && s.standbyMin <= 120);
+}
+
+void SettingsManager::clamp(Settings &s) {
+  s.tank1Time = clampInt(s.tank1Time, 0, 30);
+  s.tank2Time = clampInt(s.tank2Time, 0, 30);
+  s.tank3Time = clampInt(s.tank3Time, 0, 30);
+  s.waterPumpTime = clampInt(s.waterPumpTime, 0, 60);
+  s.milkPumpTime = clampInt(s.milkPumpTime, 0, 60);
+  s.intHeaterTime = clampInt(s.intHeaterTime, 10, 120);
+  s.intHeaterTemp = clampInt(s.intHeaterTemp, 60, 100);
+  s.extHeaterTime = clampInt(s.extHeaterTime, 10, 180);
+  s.extHeaterTemp = clampInt(s.extHeaterTemp, 60, 100);
+  s.mixerTime = clampInt(s.mixerTime, 5, 60);
+  s.audioVolume = clampInt(s.audioVolume, 0, 100);
+  s.pidKp = clampFloat(s.pidKp, 0, 50);
+  s.pidKi = clampFloat(s.pidKi, 0, 5);
+  s.pidKd = clampFloat(s.pidKd, 0, 200);
+  s.pidFf = clampFloat(s.pidFf, 0, 100);
+  s.powerBudgetW = clampInt(s.powerBudgetW, 100, 4000);
+  s.standbyTemp = clampInt(s.standbyTemp, 40, 95);
+  s.standbyMin = clampInt(s.standbyMin, 0, 120);
+}
+
+bool SettingsManager::save(const Settings &s) {
+  if (!validate(s)) {
+    LOG_ERROR("SETTINGS", "Validation failed");
+    return false;
+  }
+
+  current = s;
+  unsigned long now = millis();
+  changedAt = now;
+  if (dirtySince == 0)
+    dirtySince = now | 1;
+  return true;
+}
+
+void SettingsManager::commit() {
+  dirtySince = 0;
+  char keys[96];
+  uint8_t n = diffFields(current, stored, keys, sizeof(keys));
+  if (n == 0)
+    return;
+  if (!writeBlob(current)) {
+    LOG_ERROR("SETTINGS", "NVS write failed");
+    return;
+  }
+  stored = current;
+  LOG_INFOF("SETTINGS", "Saved to NVS | changed=%u (%s)", n, keys);
+}
+
+void SettingsManager::flushIfDue(unsigned long now) {
+  if (dirtySince == 0)
+    return;
+  if (now - changedAt < SETTINGS_COMMIT_DELAY_MS &&
+      now - dirtySince < SETTINGS_COMMIT_MAX_MS)
+    return;
+  commit();
+}
+
+void SettingsManager::setDefaults() {
+  loadDefaults();
+  save(current);
+}
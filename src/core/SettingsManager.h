@@ -0,0 +1,64 @@
+#ifndef SETTINGS_MANAGER_H
+#define SETTINGS_MANAGER_H
+
+#include "Config.h"
+#include <Preferences.h>
+
+struct Settings {
+  int tank1Time;
+  int tank2Time;
+  int tank3Time;
+  int waterPumpTime;
+  int milkPumpTime;
+  int intHeaterTime;
+  int intHeaterTemp;
+  int extHeaterTime;
+  int extHeaterTemp; // Accepted but ignored
+  int mixerTime;
+  int audioVolume; // 0..100
+  bool audioMuted;
+  float pidKp; // Thermoblock PID, % duty per C
+  float pidKi; // % duty per C*s
+  float pidKd; // % duty per C/s
+  float pidFf; // % duty added while a pump runs
+  int powerBudgetW; // Max nominal draw of overlapped drink phases
+  int standbyTemp;  // Keep-warm setpoint between orders, C
+  int standbyMin;   // Keep-warm after the last order, min (0 = off)
+  bool predictPreheat; // Brew temp ahead of the expected next order
+};
+
+// Settings persist as one versioned, CRC-32 checked NVS blob written with a
+// single putBytes(). save() applies at once but only marks the blob dirty;
+// flushIfDue() (call it from loop()) commits SETTINGS_COMMIT_DELAY_MS after
+// the last change, at most SETTINGS_COMMIT_MAX_MS after the first, and only
+// if a field differs from what NVS holds. The old one-key-per-field layout is
+// migrated on the first begin(). Values read from NVS are clamped to range;
+// save() rejects them instead.
+class SettingsManager {
+public:
+  SettingsManager();
+  void begin();
+  const Settings &get() const { return current; }
+  bool save(const Settings &s);
+  static void clamp(Settings &s);
+  void setDefaults();
+
+  void commit(); // Now, if anything changed
+  void flushIfDue(unsigned long now);
+  bool isDirty() const { return dirtySince != 0; }
+
+private:
+  Preferences prefs;
+  Settings current;
+  Settings stored; // What NVS holds
+  unsigned long dirtySince; // 0 = clean
+  unsigned long changedAt;
+
+  void loadDefaults();
+  bool validate(const Settings &s);
+  bool readBlob(Settings &out);
+  bool writeBlob(const Settings &s);
+  bool migrateLegacy(Settings &s);
+};
+
+#endif
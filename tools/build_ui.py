@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Build the LittleFS image contents for the web UI.
+
+Minifies index.html (conservatively: indentation, blank lines, HTML and
+whole-line // comments) and writes it gzip-compressed to data/index.html.gz.
+The firmware serves *.gz with Content-Encoding: gzip and a content-hash ETag,
+so only the compressed copy needs to be uploaded.
+
+Usage: python3 tools/build_ui.py [--out data] [files...]
+"""
+import argparse
+import gzip
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DEFAULT_FILES = ["index.html"]
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    out = []
+    in_pre = False
+    for line in text.splitlines():
+        if in_pre:
+            out.append(line)
+            in_pre = "</pre>" not in line
+            continue
+        stripped = line.strip()
+        if not stripped or stripped.startswith("//"):
+            continue
+        out.append(stripped)
+        in_pre = "<pre" in stripped and "</pre>" not in stripped
+    return "\n".join(out) + "\n"
+
+
+def build(src, out_dir):
+    with open(src, "r", encoding="utf-8") as f:
+        raw = f.read()
+    body = raw
+    if src.endswith((".html", ".htm")):
+        body = minify_html(raw)
+    data = body.encode("utf-8")
+
+    name = os.path.basename(src)
+    dst = os.path.join(out_dir, name + ".gz")
+    # mtime=0 keeps the output (and so the ETag) stable across builds
+    with open(dst, "wb") as f:
+        with gzip.GzipFile(filename=name, mode="wb", fileobj=f, compresslevel=9, mtime=0) as gz:
+            gz.write(data)
+
+    size_raw = len(raw.encode("utf-8"))
+    size_gz = os.path.getsize(dst)
+    print("%-14s %7d -> %6d min -> %6d gz (%d%%)" % (
+        name, size_raw, len(data), size_gz, 100 * size_gz // max(size_raw, 1)))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--out", default=os.path.join(ROOT, "data"))
+    ap.add_argument("files", nargs="*")
+    args = ap.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    files = args.files or [os.path.join(ROOT, f) for f in DEFAULT_FILES]
+    for src in files:
+        build(src, args.out)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
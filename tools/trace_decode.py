@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Decode an order trace from GET /api/trace?order=<id> into CSV.
+
+File: "CMTR", u8 version, u8 tick ms, u16 block bytes, then blocks of
+[u16 len][keyframe, records...]. See src/app/Trace.cpp.
+
+Usage: python3 tools/trace_decode.py trace-12.bin > trace-12.csv
+"""
+import struct
+import sys
+
+# State byte per trace version; 2 = MachineController order (src/core)
+STATES = {
+    1: [
+        "IDLE", "VALIDATE", "SOLIDS", "LIQUID", "HEAT_INTERNAL_PREHEAT",
+        "HEAT_INTERNAL_ACTIVE", "HEAT_EXTERNAL", "MIX_DOWN", "MIX_RUN",
+        "MIX_UP", "DONE", "ERROR", "SAFE_STOP", "AUTOTUNE",
+    ],
+    2: [
+        "IDLE", "VALIDATE", "DISPENSE_SOLIDS", "HEAT_INTERNAL_PREHEAT",
+        "HEAT_INTERNAL_ACTIVE", "HEAT_EXTERNAL", "DISPENSE_LIQUID", "MIX_DOWN",
+        "MIX_RUN", "MIX_UP", "DONE", "ERROR", "SAFE_STOP", "AUTOTUNE",
+    ],
+}
+NAN = -32768
+F_INT, F_EXT, F_CUP, F_RELAYS, F_STATE = 0x01, 0x02, 0x04, 0x08, 0x10
+
+
+def uvarint(buf, i):
+    v = shift = 0
+    while True:
+        b = buf[i]
+        i += 1
+        v |= (b & 0x7F) << shift
+        shift += 7
+        if b < 0x80:
+            return v, i
+
+
+def zigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def version_of(data):
+    if len(data) < 8 or data[:4] != b"CMTR":
+        raise ValueError("not a trace file")
+    version = data[4]
+    if version not in STATES:
+        raise ValueError("unsupported trace version %d" % version)
+    return version
+
+
+def samples(data):
+    version_of(data)
+    tick_ms = data[5]
+    pos = 8
+    while pos + 2 <= len(data):
+        (n,) = struct.unpack_from("<H", data, pos)
+        block = data[pos + 2:pos + 2 + n]
+        pos += 2 + n
+        if len(block) < n:
+            break  # cut short (order still recording)
+        ms, t_int, t_ext, cup, relays, state = struct.unpack_from("<IhhhHB", block, 0)
+        ticks = ms // tick_ms
+        yield ms, t_int, t_ext, cup, relays, state
+        i = 13
+        while i < n:
+            mask = block[i]
+            dt, i = uvarint(block, i + 1)
+            ticks += dt
+            if mask & F_INT:
+                d, i = uvarint(block, i)
+                t_int += zigzag(d)
+            if mask & F_EXT:
+                d, i = uvarint(block, i)
+                t_ext += zigzag(d)
+            if mask & F_CUP:
+                d, i = uvarint(block, i)
+                cup += zigzag(d)
+            if mask & F_RELAYS:
+                relays, i = uvarint(block, i)
+            if mask & F_STATE:
+                state = block[i]
+                i += 1
+            yield ticks * tick_ms, t_int, t_ext, cup, relays, state
+
+
+def fmt(v, per_unit):
+    return "" if v == NAN else "%g" % (v / per_unit)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__.strip().splitlines()[-1])
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    states = STATES[version_of(data)]
+    print("ms,int_c,ext_c,cup_cm,relays,state")
+    for ms, t_int, t_ext, cup, relays, state in samples(data):
+        name = states[state] if state < len(states) else str(state)
+        print("%d,%s,%s,%s,0x%03x,%s" % (ms, fmt(t_int, 4), fmt(t_ext, 4),
+                                         fmt(cup, 10), relays, name))
+
+
+if __name__ == "__main__":
+    main()